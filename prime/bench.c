@@ -0,0 +1,244 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "primes.h"
+
+#define die(...) { fprintf(stderr, ##__VA_ARGS__); exit(1); }
+
+
+const char help_msg[] =
+	"Usage:  bench [-f csv|json] [-t SECONDS] [-m MAGNITUDE]\n"
+	"\n"
+	"Time the primality tests, sieves and factorizations on numbers of each\n"
+	"magnitude from 1e6 to 1e12 and report numbers per second and ns per number\n"
+	"\n"
+	"Options:\n"
+	"  -f, --format FORMAT    Write results as 'csv' (default) or 'json'\n"
+	"  -t, --time SECONDS     Least time spent on each measurement, 0.2 by default\n"
+	"  -m, --max MAGNITUDE    Largest magnitude to run at, 1e12 by default\n"
+	"  -h, --help             Give this help list\n"
+;
+
+
+// Least time in seconds a measurement must take before it is used
+double min_time = 0.2;
+
+// Wall clock time in seconds
+double now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+// Functions being timed, each works on the n numbers from lower
+// and returns a checksum such as the number of primes found
+
+P_INT run_sieve(P_INT lower, P_INT n){
+	(void)lower;  // Always sieves from 0
+	unsigned char *bs = malloc(n);
+	P_INT count = prime_sieve(bs, n);
+	free(bs);
+	return count;
+}
+
+P_INT run_sieve_bs(P_INT lower, P_INT n){
+	(void)lower;  // Always sieves from 0
+	bits_t bs = malloc(byte_size(n));
+	P_INT count = prime_sieve_bs(bs, n);
+	free(bs);
+	return count;
+}
+
+P_INT run_sieve_seg(P_INT lower, P_INT n){
+	bits_t bs = malloc(byte_size(n));
+	P_INT count = prime_sieve_seg(bs, lower, lower + n - 1);
+	free(bs);
+	return count;
+}
+
+P_INT run_sieve_w30(P_INT lower, P_INT n){
+	unsigned char *bs = malloc(w30_size(n + 30));
+	P_INT count = prime_sieve_w30(bs, lower, lower + n - 1);
+	free(bs);
+	return count;
+}
+
+P_INT run_wheel(P_INT lower, P_INT n){
+	P_INT x, count = 0;
+	for(x = lower; x < lower + n; x++) count += is_prime_w(x, PWHEEL_30);
+	return count;
+}
+
+P_INT run_fermat(P_INT lower, P_INT n){
+	P_INT x, count = 0;
+	for(x = lower; x < lower + n; x++) count += is_prime_fmt(x, PWHEEL_30, 0.1);
+	return count;
+}
+
+P_INT run_miller_rabin(P_INT lower, P_INT n){
+	static P_INT wits[] = {2, 3, 5, 7, 11, 13, 17};
+	P_INT x, count = 0;
+	for(x = lower; x < lower + n; x++) count += is_prime_mr(x, 7, wits);
+	return count;
+}
+
+P_INT run_miller_rabin64(P_INT lower, P_INT n){
+	P_INT x, count = 0;
+	for(x = lower; x < lower + n; x++) count += is_prime_mr64(x);
+	return count;
+}
+
+P_INT run_bpsw(P_INT lower, P_INT n){
+	P_INT x, count = 0;
+	for(x = lower; x < lower + n; x++) count += is_prime_bpsw(x);
+	return count;
+}
+
+P_INT run_miller_rabin_batch(P_INT lower, P_INT n){
+	P_INT *xs = calloc(n, sizeof(P_INT)), x, count = 0;
+	uint8_t *res = malloc(n);
+	for(x = 0; x < n; x++) xs[x] = lower + x;
+	is_prime_mr_batch(xs, n, res);
+	for(x = 0; x < n; x++) count += res[x];
+	free(res);
+	free(xs);
+	return count;
+}
+
+P_INT run_factorize_w(P_INT lower, P_INT n){
+	P_INT x, count = 0;
+	int pow;
+	for(x = lower; x < lower + n; x++){
+		for(P_INT fac = factorize_w(x, PWHEEL_30, &pow); fac; fac = factorize_w(0, NULL, &pow)) count++;
+	}
+	return count;
+}
+
+P_INT run_factorize_rho(P_INT lower, P_INT n){
+	P_INT x, count = 0, primes[RHO_MAX_FACTORS];
+	int pows[RHO_MAX_FACTORS];
+	for(x = lower; x < lower + n; x++) count += factorize_rho(x, primes, pows);
+	return count;
+}
+
+// Checksum counts distinct prime factors of every number
+static void count_factors(P_INT x, const P_INT *primes, const int *pows, int len, void *arg){
+	(void)x;  (void)primes;  (void)pows;
+	*(P_INT *)arg += len;
+}
+
+P_INT run_factorize_range(P_INT lower, P_INT n){
+	P_INT count = 0;
+	factorize_range(lower, lower + n - 1, count_factors, &count);
+	return count;
+}
+
+
+struct bench_s{
+	const char *name;
+	P_INT (*fn)(P_INT lower, P_INT n);
+	int from_zero;  // Whether the function always covers [0, magnitude) instead of numbers from the magnitude
+	P_INT max_mag;  // Largest magnitude it is run at
+};
+
+struct bench_s benches[] = {
+	{"prime_sieve", run_sieve, 1, 100000000ULL},
+	{"prime_sieve_bs", run_sieve_bs, 1, 1000000000ULL},
+	{"prime_sieve_seg", run_sieve_seg, 0, 1000000000000ULL},
+	{"prime_sieve_w30", run_sieve_w30, 0, 1000000000000ULL},
+	{"is_prime_w", run_wheel, 0, 1000000000000ULL},
+	{"is_prime_fmt", run_fermat, 0, 1000000000000ULL},
+	{"is_prime_mr", run_miller_rabin, 0, 1000000000000ULL},
+	{"is_prime_mr64", run_miller_rabin64, 0, 1000000000000ULL},
+	{"is_prime_mr_batch", run_miller_rabin_batch, 0, 1000000000000ULL},
+	{"is_prime_bpsw", run_bpsw, 0, 1000000000000ULL},
+	{"factorize_w", run_factorize_w, 0, 1000000000000ULL},
+	{"factorize_rho", run_factorize_rho, 0, 1000000000000ULL},
+	{"factorize_range", run_factorize_range, 0, 1000000000000ULL},
+	{NULL}
+};
+
+
+// Most numbers a single measurement covers
+#define MAX_NUMBERS (1ULL << 26)
+
+/* Time fn on numbers of the given magnitude
+ * Functions covering [0, magnitude) are timed once, the rest are run on
+ * twice as many numbers until the run takes at least min_time
+ */
+double measure(struct bench_s *b, P_INT mag, P_INT *n, P_INT *result){
+	double start, elapsed;
+	*n = b->from_zero ? mag : 1024;
+	for(;;){
+		start = now();
+		*result = b->fn(mag, *n);
+		elapsed = now() - start;
+		if(b->from_zero || elapsed >= min_time || *n >= MAX_NUMBERS) return elapsed;
+		*n *= 2;
+	}
+}
+
+
+int main(int argc, char *argv[]){
+	struct option longopts[] = {
+		{"format", required_argument, NULL, 'f'},
+		{"time", required_argument, NULL, 't'},
+		{"max", required_argument, NULL, 'm'},
+		{"help", no_argument, NULL, 'h'},
+		{0}
+	};
+	
+	int c, json = 0;
+	P_INT max_mag = 1000000000000ULL;
+	char *endptr;
+	while((c = getopt_long(argc, argv, "f:t:m:h", longopts, NULL)) >= 0){
+		switch(c){
+			case 'f':
+				if(strcmp(optarg, "json") == 0) json = 1;
+				else if(strcmp(optarg, "csv") == 0) json = 0;
+				else die("Unknown format \"%s\"\n", optarg);
+			break;
+			case 't':
+				min_time = strtod(optarg, &endptr);
+				if(*endptr || min_time < 0) die("Failed to parse time \"%s\"\n", optarg);
+			break;
+			case 'm':
+				max_mag = (P_INT)strtod(optarg, &endptr);
+				if(*endptr) die("Failed to parse magnitude \"%s\"\n", optarg);
+			break;
+			case 'h':
+				puts(help_msg);
+				return 0;
+			default: die("Call with -h or --help flag for more information\n");
+		}
+	}
+	
+	if(json) puts("[");
+	else puts("method,magnitude,numbers,seconds,numbers_per_sec,ns_per_number,result");
+	
+	const char *sep = "";
+	for(struct bench_s *b = benches; b->name; b++){
+		for(P_INT mag = 1000000; mag <= max_mag && mag <= b->max_mag; mag *= 1000){
+			P_INT n, result;
+			double secs = measure(b, mag, &n, &result);
+			double rate = secs > 0 ? n / secs : 0, ns = 1e9 * secs / n;
+			
+			if(json){
+				printf("%s  {\"method\": \"%s\", \"magnitude\": %llu, \"numbers\": %llu, \"seconds\": %.6f, "
+					"\"numbers_per_sec\": %.1f, \"ns_per_number\": %.3f, \"result\": %llu}",
+					sep, b->name, mag, n, secs, rate, ns, result);
+				sep = ",\n";
+			}else{
+				printf("%s,%llu,%llu,%.6f,%.1f,%.3f,%llu\n", b->name, mag, n, secs, rate, ns, result);
+			}
+			fflush(stdout);
+		}
+	}
+	if(json) puts("\n]");
+	
+	return 0;
+}
@@ -1,8 +1,11 @@
 #ifndef _BIT_ARRAY_H
 #define _BIT_ARRAY_H
 
+#include <stdint.h>
+#include <string.h>
+
 #ifndef BIT_TYPE
-#define BIT_TYPE unsigned char
+#define BIT_TYPE uint64_t
 #endif
 
 #define BIT_SIZE (8 * sizeof(BIT_TYPE))
@@ -24,8 +27,9 @@
  * 
  * Returns:
  *   unsigned int : number of bytes needed to store n bits
+ *     NOTE: This is rounded up to a whole number of BIT_TYPEs
  */
-#define byte_size(n) (((n) % 8 == 0 ? 0 : 1) + (n) / 8)
+#define byte_size(n) (elem_size(n) * sizeof(BIT_TYPE))
 
 /* Get ith bit from bs
  * 
@@ -46,7 +50,7 @@
  *   BIT_TYPE v : value to change bit to
  *     NOTE: only the LSB of v will be used
  */
-#define setbit(bs, i, v) if(0x01 & (v)){(bs)[(i) / BIT_SIZE] |= 1 << ((i) % BIT_SIZE);}else{(bs)[(i) / BIT_SIZE] &= ~(BIT_TYPE)(1 << ((i) % BIT_SIZE));}
+#define setbit(bs, i, v) if(0x01 & (v)){(bs)[(i) / BIT_SIZE] |= (BIT_TYPE)1 << ((i) % BIT_SIZE);}else{(bs)[(i) / BIT_SIZE] &= ~((BIT_TYPE)1 << ((i) % BIT_SIZE));}
 
 /* Toggle value of ith bit in bs
  * 
@@ -54,7 +58,98 @@
  *   bits_t bs : array of bits
  *   unsigned int i : index of bit to toggle
  */
-#define toggle_bit(bs, i) ((bs)[(i) / BIT_SIZE] ^= 1 << ((i) % BIT_SIZE))
+#define toggle_bit(bs, i) ((bs)[(i) / BIT_SIZE] ^= (BIT_TYPE)1 << ((i) % BIT_SIZE))
 
 typedef BIT_TYPE *bits_t;
+
+/* Count the set bits of bs with index in [from, to)
+ * a whole BIT_TYPE at a time, masking the partial words at either end
+ * 
+ * Arguments:
+ *   bits_t bs : array of bits
+ *   unsigned long long from : index of first bit to count
+ *   unsigned long long to : index after the last bit to count
+ * 
+ * Returns:
+ *   unsigned long long : number of bits set to 1
+ */
+static inline unsigned long long count_bits(const BIT_TYPE *bs, unsigned long long from, unsigned long long to){
+	if(from >= to) return 0;
+	unsigned long long i = from / BIT_SIZE, last = (to - 1) / BIT_SIZE, count;
+	BIT_TYPE head = bs[i] & (BIT_TYPE)(~(BIT_TYPE)0 << (from % BIT_SIZE));
+	BIT_TYPE tail_mask = (BIT_TYPE)~(BIT_TYPE)0 >> (BIT_SIZE - 1 - (to - 1) % BIT_SIZE);
+	if(i == last) return __builtin_popcountll(head & tail_mask);
+	
+	count = __builtin_popcountll(head);
+	for(i++; i < last; i++) count += __builtin_popcountll(bs[i]);
+	return count + __builtin_popcountll(bs[last] & tail_mask);
+}
+
+
+
+/* Wheel compressed bit arrays only store the numbers coprime to 30
+ * using one byte for every 30 numbers. Bit j of byte k stores 30 * k + r
+ * where r is the jth of the residues 1, 7, 11, 13, 17, 19, 23, 29.
+ * These are the numbers generated by the increments of PWHEEL_30.
+ */
+
+// Bit index of each residue modulo 30 or 8 if it isn't coprime to 30
+static const unsigned char W30_BIT[30] = {
+	8, 0, 8, 8, 8, 8, 8, 1, 8, 8, 8, 2, 8, 3, 8,
+	8, 8, 4, 8, 5, 8, 8, 8, 6, 8, 8, 8, 8, 8, 7
+};
+// Residue modulo 30 stored by each bit
+static const unsigned char W30_RESIDUE[8] = {1, 7, 11, 13, 17, 19, 23, 29};
+
+/* Convert number of integers into number of bytes in wheel bit array
+ * 
+ * Arguments:
+ *   unsigned int n : number of integers starting from a multiple of 30
+ * 
+ * Returns:
+ *   unsigned int : number of bytes needed to store n integers
+ */
+#define w30_size(n) (((n) % 30 == 0 ? 0 : 1) + (n) / 30)
+
+/* Get bit for x from wheel bit array bs
+ * 
+ * Arguments:
+ *   unsigned char *bs : wheel compressed array of bits
+ *   unsigned int x : integer whose bit to get
+ *     NOTE: 0 is returned for any x not coprime to 30
+ * 
+ * Returns:
+ *   int : desired bit for x
+ */
+#define getbit30(bs, x) (W30_BIT[(x) % 30] < 8 && (((bs)[(x) / 30] >> W30_BIT[(x) % 30]) & 0x1))
+
+/* Clear bit for x in wheel bit array bs
+ * 
+ * Arguments:
+ *   unsigned char *bs : wheel compressed array of bits
+ *   unsigned int x : integer whose bit to clear
+ *     NOTE: x must be coprime to 30
+ */
+#define clearbit30(bs, x) ((bs)[(x) / 30] &= ~(unsigned char)(1 << W30_BIT[(x) % 30]))
+
+/* Count the set bits in the first n bytes of wheel bit array bs
+ * eight bytes at a time
+ * 
+ * Arguments:
+ *   unsigned char *bs : wheel compressed array of bits
+ *   unsigned long long n : number of bytes to count
+ * 
+ * Returns:
+ *   unsigned long long : number of bits set to 1
+ */
+static inline unsigned long long count_bits30(const unsigned char *bs, unsigned long long n){
+	unsigned long long i, count = 0;
+	uint64_t word;
+	for(i = 0; i + 8 <= n; i += 8){
+		memcpy(&word, bs + i, 8);
+		count += __builtin_popcountll(word);
+	}
+	for(; i < n; i++) count += __builtin_popcount(bs[i]);
+	return count;
+}
 #endif
@@ -0,0 +1,106 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+/* Print the prime and increment tables for the wheels built from the primes
+ * below each bound as C source for primes.c
+ * Each wheel has the same layout as the ones built by make_pwheel, the
+ * first increment goes from 1 to the next number coprime to the modulus
+ * and the last goes from modulus - 1 back around to modulus + 1
+ * 
+ * Usage:
+ *   gen_wheels [TDIV_BOUND] > wheel_tables.h
+ * 
+ * Also prints the table of odd primes below TDIV_BOUND, rounded up to a
+ * multiple of 30030 so the prebuilt wheels line up with its end, along
+ * with their inverses used for trial division without dividing
+ * Each wheel records where its numbers continue past the end of the table
+ */
+
+// Bound on the primes of each wheel and the name of its modulus
+static const struct { unsigned int max; const char *name; } WHEELS[] = {
+	{8, "210"}, {12, "2310"}, {14, "30030"}
+};
+
+static void print_wheel(unsigned int max, const char *name, unsigned long bound){
+	unsigned int primes[16], nprimes = 0, n, k;
+	unsigned long product = 1;
+	for(n = 2; n < max; n++){
+		for(k = 0; k < nprimes && n % primes[k]; k++);
+		if(k == nprimes){
+			primes[nprimes++] = n;
+			product *= n;
+		}
+	}
+	
+	// Mark the numbers sharing a factor with the modulus
+	char *coprime = malloc(product + 2);
+	for(n = 0; n < product + 2; n++) coprime[n] = 1;
+	for(k = 0; k < nprimes; k++) for(n = 0; n < product + 2; n += primes[k]) coprime[n] = 0;
+	
+	printf("static unsigned char W%s_PRIMES[] = {", name);
+	for(k = 0; k < nprimes; k++) printf(k ? ", %u" : "%u", primes[k]);
+	printf("};\n");
+	
+	printf("static unsigned char W%s_INCS[] = {", name);
+	unsigned int last = 1, len = 0;
+	for(n = 2; n < product + 2; n++) if(coprime[n]){
+		// Break lines every 24 increments
+		if(len % 24) printf(", ");
+		else printf(len ? ",\n\t" : "\n\t");
+		printf("%u", n - last);
+		last = n;
+		len++;
+	}
+	printf("\n};\n");
+	
+	// The bound is a multiple of the modulus so trial division past the table starts a turn at bound + 1
+	printf("static struct pwheel_s WHL_%s_s = {W%s_PRIMES, W%s_PRIMES + %u, W%s_INCS, W%s_INCS + %u, W%s_INCS, %luULL};\n",
+		name, name, name, nprimes - 1, name, name, len - 1, name, bound + 1);
+	printf("pwheel_t PWHEEL_%s = &WHL_%s_s;\n\n", name, name);
+	free(coprime);
+}
+
+// Default bound on the primes of the trial division table, the makefile gives the tradeoff
+#define TDIV_BOUND_DEFAULT (1UL << 20)
+// Largest bound, the default's 82200 entries of 24 bytes are a 2 MB table in a
+// 4.6 MB header and this one's million entries are 26 MB in about 60 MB
+#define TDIV_BOUND_MAX (1UL << 24)
+
+// Print the table of odd primes below bound and return the bound it was rounded up to
+static unsigned long print_tdiv(unsigned long bound){
+	bound = (bound + 30029) / 30030 * 30030;
+	char *composite = calloc(bound, 1);
+	unsigned long n, k, len = 0;
+	
+	printf("// Odd primes below the bound with p * inv == 1 (mod 2^64) and lim = (2^64 - 1) / p\n");
+	printf("#define TDIV_BOUND %luULL\n", bound);
+	printf("static const struct tdiv_s TDIV_PRIMES[] = {");
+	for(n = 3; n < bound; n += 2){
+		if(composite[n]) continue;
+		for(k = n * n; k < bound; k += 2 * n) composite[k] = 1;
+		
+		// Newton's iteration doubles the correct low bits each step from n * n == 1 (mod 8)
+		uint64_t inv = n;
+		for(int i = 0; i < 5; i++) inv *= 2 - n * inv;
+		printf(len++ % 3 ? " " : "\n\t");
+		printf("{0x%016llxULL, 0x%016llxULL, %lu},", (unsigned long long)inv, (unsigned long long)(UINT64_MAX / n), n);
+	}
+	printf("\n};\n");
+	printf("#define TDIV_LEN %lu\n\n", len);
+	free(composite);
+	return bound;
+}
+
+int main(int argc, char *argv[]){
+	unsigned long bound = argc > 1 ? strtoul(argv[1], NULL, 10) : TDIV_BOUND_DEFAULT;
+	if(bound < 64 || bound > TDIV_BOUND_MAX){
+		fprintf(stderr, "Trial division bound must be from 64 to %lu\n", TDIV_BOUND_MAX);
+		return 1;
+	}
+	
+	printf("// Generated by gen_wheels, do not edit\n\n");
+	bound = print_tdiv(bound);
+	for(size_t i = 0; i < sizeof(WHEELS) / sizeof(WHEELS[0]); i++) print_wheel(WHEELS[i].max, WHEELS[i].name, bound);
+	return 0;
+}
@@ -0,0 +1,98 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "input.h"
+
+// Bytes read at a time when the input can't be mapped
+#define INBUF_BLOCK (1 << 20)
+
+int inbuf_open(inbuf_t *in, const char *path){
+	memset(in, 0, sizeof(*in));
+	in->fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+	if(in->fd < 0) return -1;
+	
+	// Map regular files whole, the pages are read in as they are parsed
+	struct stat st;
+	if(fstat(in->fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0){
+		void *buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, in->fd, 0);
+		if(buf != MAP_FAILED){
+			madvise(buf, st.st_size, MADV_SEQUENTIAL);
+			in->buf = buf;
+			in->len = st.st_size;
+			in->mapped = in->eof = 1;
+			return 0;
+		}
+	}
+	
+	in->cap = INBUF_BLOCK;
+	in->block = malloc(in->cap);
+	in->buf = in->block;
+	return 0;
+}
+
+// Move the unparsed bytes to the front of the block and read more after them
+static int inbuf_fill(inbuf_t *in){
+	size_t left = in->len - in->pos;
+	if(left == in->cap) return -1;  // No number is that long
+	memmove(in->block, in->block + in->pos, left);
+	in->offset += in->pos;
+	in->pos = 0;
+	in->len = left;
+	
+	while(in->len < in->cap){
+		ssize_t n = read(in->fd, in->block + in->len, in->cap - in->len);
+		if(n < 0){
+			if(errno == EINTR) continue;
+			return -1;
+		}
+		if(n == 0){
+			in->eof = 1;
+			break;
+		}
+		in->len += n;
+	}
+	return 0;
+}
+
+ptrdiff_t inbuf_read(inbuf_t *in, P_INT *xs, size_t max){
+	size_t n = 0;
+	while(n < max){
+		const char *buf = in->buf;
+		size_t pos = in->pos, len = in->len;
+		
+		// Skip separators
+		for(; pos < len && (buf[pos] == ' ' || buf[pos] == ',' || (buf[pos] >= '\t' && buf[pos] <= '\r')); pos++);
+		in->pos = pos;
+		
+		// A number running up to the end of a block may continue in the next
+		size_t end = pos;
+		for(; end < len && (unsigned char)(buf[end] - '0') < 10; end++);
+		if(end == len && !in->eof){
+			if(inbuf_fill(in)) return n ? (ptrdiff_t)n : -1;
+			continue;
+		}
+		if(pos == len) break;
+		if(end == pos) return n ? (ptrdiff_t)n : -1;
+		
+		P_INT x = 0;
+		for(; pos < end; pos++){
+			if(__builtin_mul_overflow(x, 10, &x) || __builtin_add_overflow(x, (P_INT)(buf[pos] - '0'), &x)) return n ? (ptrdiff_t)n : -1;
+		}
+		xs[n++] = x;
+		in->pos = pos;
+	}
+	return n;
+}
+
+void inbuf_close(inbuf_t *in){
+	if(in->mapped) munmap((void *)in->buf, in->len);
+	free(in->block);
+	if(in->fd != STDIN_FILENO) close(in->fd);
+	in->buf = in->block = NULL;
+	in->len = in->pos = 0;
+}
@@ -0,0 +1,60 @@
+#ifndef _INPUT_H
+#define _INPUT_H
+
+#include <stddef.h>
+
+#include "primes.h"
+
+/* Source of decimal numbers separated by whitespace or commas
+ * A regular file is mapped into memory and parsed in place, anything
+ * else such as a pipe is read in large blocks
+ */
+typedef struct inbuf_s{
+	const char *buf;  // Mapped file or block of bytes read
+	size_t len;  // Bytes held in buf
+	size_t pos;  // Bytes of buf parsed so far
+	size_t offset;  // Bytes of the input before buf
+	int fd;
+	int mapped;  // Whether buf is the mapped file
+	int eof;  // Whether everything has been read into buf
+	char *block;  // Memory for the blocks read when the file isn't mapped
+	size_t cap;
+} inbuf_t;
+
+/* Open a file of numbers
+ * 
+ * Usage:
+ *   inbuf_t in;
+ *   P_INT xs[1024];
+ *   inbuf_open(&in, "-");  // Read from standard input
+ *   for(ptrdiff_t n; (n = inbuf_read(&in, xs, 1024)) > 0;) ...
+ *   inbuf_close(&in);
+ * 
+ * Arguments:
+ *   inbuf_t *in : input to setup
+ *   const char *path : file to read or "-" for standard input
+ * 
+ * Returns:
+ *   int : 0 on success or -1 if the file couldn't be opened
+ */
+int inbuf_open(inbuf_t *in, const char *path);
+
+/* Parse the next numbers in the input
+ * 
+ * Arguments:
+ *   inbuf_t *in : input to parse
+ *   P_INT *xs : location to store the numbers
+ *   size_t max : most numbers to store
+ * 
+ * Returns:
+ *   ptrdiff_t : number of numbers stored, 0 at the end of the input or -1
+ *     on a number above 2^64 - 1, a character other than a digit, whitespace
+ *     or comma, or a failed read, with the byte offset of the problem in
+ *     in->offset + in->pos. The numbers before a problem are returned first.
+ */
+ptrdiff_t inbuf_read(inbuf_t *in, P_INT *xs, size_t max);
+
+// Unmap or free the input and close its file
+void inbuf_close(inbuf_t *in);
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef _MONT_H
+#define _MONT_H
+
+#include <stdint.h>
+
+/* Montgomery arithmetic modulo an odd 64-bit number n
+ * Numbers are stored in Montgomery form a * 2^64 (mod n) so that
+ * a product can be reduced with two multiplies instead of a divide
+ */
+typedef struct mont_s{
+	uint64_t n;  // Odd modulus
+	uint64_t inv;  // n^-1 (mod 2^64)
+	uint64_t one;  // 2^64 (mod n), the Montgomery form of 1
+	uint64_t r2;  // 2^128 (mod n), used to convert into Montgomery form
+} mont_t;
+
+/* Setup Montgomery constants for the modulus n
+ * 
+ * Arguments:
+ *   mont_t *m : location to store constants in
+ *   uint64_t n : odd modulus greater than 1
+ */
+static inline void mont_init(mont_t *m, uint64_t n){
+	m->n = n;
+	
+	// Newton's iteration doubles the correct low bits each step
+	// starting from n * n == 1 (mod 8) for odd n
+	uint64_t inv = n;
+	for(int i = 0; i < 5; i++) inv *= 2 - n * inv;
+	m->inv = inv;
+	
+	m->one = (uint64_t)(((unsigned __int128)1 << 64) % n);
+	m->r2 = (uint64_t)((unsigned __int128)m->one * m->one % n);
+}
+
+/* Montgomery reduction of a 128-bit product t < n * 2^64
+ * 
+ * Returns:
+ *   uint64_t : t * 2^-64 (mod n) in [0, n)
+ */
+static inline uint64_t mont_reduce(const mont_t *m, unsigned __int128 t){
+	uint64_t q = (uint64_t)t * m->inv;
+	uint64_t hi = (uint64_t)(t >> 64), qn = (uint64_t)(((unsigned __int128)q * m->n) >> 64);
+	// The low halves of t and q * n are equal so only the high halves remain
+	return hi >= qn ? hi - qn : hi - qn + m->n;
+}
+
+// Product of a and b in Montgomery form
+static inline uint64_t mont_mul(const mont_t *m, uint64_t a, uint64_t b){
+	return mont_reduce(m, (unsigned __int128)a * b);
+}
+
+// Convert a into Montgomery form
+static inline uint64_t mont_to(const mont_t *m, uint64_t a){
+	return mont_mul(m, a % m->n, m->r2);
+}
+
+// Convert a out of Montgomery form
+static inline uint64_t mont_from(const mont_t *m, uint64_t a){
+	return mont_reduce(m, a);
+}
+
+// Sum and difference of a and b in Montgomery form (or plain residues)
+static inline uint64_t mont_add(const mont_t *m, uint64_t a, uint64_t b){
+	return a >= m->n - b ? a - (m->n - b) : a + b;
+}
+static inline uint64_t mont_sub(const mont_t *m, uint64_t a, uint64_t b){
+	return a >= b ? a - b : a + (m->n - b);
+}
+
+/* Raise a to the power e
+ * 
+ * Arguments:
+ *   uint64_t a : base in Montgomery form
+ *   uint64_t e : exponent
+ * 
+ * Returns:
+ *   uint64_t : a^e in Montgomery form
+ */
+static inline uint64_t mont_pow(const mont_t *m, uint64_t a, uint64_t e){
+	uint64_t work = m->one;
+	for(; e > 0; e >>= 1){
+		if(e & 1) work = mont_mul(m, work, a);
+		a = mont_mul(m, a, a);
+	}
+	return work;
+}
+
+#endif
@@ -0,0 +1,83 @@
+#include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "output.h"
+
+// Most buffers given to a single call of writev
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+void outbuf_init(outbuf_t *out, int fd, size_t cap){
+	out->buf = malloc(cap);
+	out->len = 0;
+	out->cap = cap;
+	out->fd = fd;
+	out->written = 0;
+	out->err = 0;
+}
+
+// Write all of iov[0..cnt) retrying after partial writes
+static int writev_all(int fd, struct iovec *iov, int cnt){
+	while(cnt > 0){
+		ssize_t n = writev(fd, iov, cnt);
+		if(n < 0){
+			if(errno == EINTR) continue;
+			return -1;
+		}
+		
+		// Skip the buffers that were completely written
+		for(; cnt > 0 && (size_t)n >= iov->iov_len; iov++, cnt--) n -= iov->iov_len;
+		if(cnt > 0){
+			iov->iov_base = (char *)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+	return 0;
+}
+
+int outbuf_flush(outbuf_t *out){
+	if(out->err){
+		out->len = 0;
+		return -1;
+	}
+	if(out->fd < 0 || out->len == 0) return 0;
+	
+	struct iovec iov = {out->buf, out->len};
+	if(writev_all(out->fd, &iov, 1)){
+		out->err = errno;
+		out->len = 0;
+		return -1;
+	}
+	out->written += out->len;
+	out->len = 0;
+	return 0;
+}
+
+void outbuf_free(outbuf_t *out){
+	outbuf_flush(out);
+	free(out->buf);
+	out->buf = NULL;
+	out->len = out->cap = 0;
+}
+
+void outbuf_room(outbuf_t *out, size_t n){
+	// After a failed write the flush only drops the contents, err keeps the failure
+	if(out->fd >= 0) outbuf_flush(out);
+	if(out->cap - out->len >= n) return;
+	
+	// Grow the buffer geometrically
+	size_t cap = out->cap ? out->cap : 64;
+	while(cap - out->len < n) cap <<= 1;
+	out->buf = realloc(out->buf, cap);
+	out->cap = cap;
+}
+
+int outbuf_writev(int fd, struct iovec *iov, size_t cnt){
+	for(; cnt > IOV_MAX; iov += IOV_MAX, cnt -= IOV_MAX){
+		if(writev_all(fd, iov, IOV_MAX)) return -1;
+	}
+	return writev_all(fd, iov, (int)cnt);
+}
@@ -0,0 +1,113 @@
+#ifndef _OUTPUT_H
+#define _OUTPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/uio.h>
+
+/* Buffer of text waiting to be written
+ * With a file descriptor the buffer is written out whenever it fills,
+ * otherwise it grows in memory until the owner takes its contents
+ */
+typedef struct outbuf_s{
+	char *buf;
+	size_t len;  // Bytes held in buf
+	size_t cap;  // Bytes allocated for buf
+	int fd;  // File descriptor to write to or -1 to keep everything in memory
+	size_t written;  // Bytes written to fd so far
+	int err;  // errno of the first failed write, after which nothing more is written
+} outbuf_t;
+
+/* Setup an output buffer
+ * 
+ * Usage:
+ *   outbuf_t out;
+ *   outbuf_init(&out, 1, 1 << 20);  // Buffer for stdout
+ *   outbuf_u64(&out, 12345);
+ *   outbuf_put(&out, "\n", 1);
+ *   outbuf_free(&out);  // Writes "12345\n"
+ * 
+ * Arguments:
+ *   outbuf_t *out : buffer to setup
+ *   int fd : file descriptor to write to or -1 to only buffer in memory
+ *   size_t cap : initial size of the buffer in bytes
+ */
+void outbuf_init(outbuf_t *out, int fd, size_t cap);
+
+/* Write out everything held in the buffer
+ * Does nothing for a buffer without a file descriptor
+ * A failed write is kept in err and the buffer's contents are dropped
+ * 
+ * Returns:
+ *   int : 0 on success or -1 if this or any earlier write failed
+ */
+int outbuf_flush(outbuf_t *out);
+
+// Flush the buffer and release its memory
+void outbuf_free(outbuf_t *out);
+
+// Make room for at least n more bytes by flushing or growing the buffer
+// Once a write has failed the contents are dropped instead of written
+void outbuf_room(outbuf_t *out, size_t n);
+
+/* Write every buffer in order to fd with as few calls to writev as possible
+ * 
+ * Arguments:
+ *   int fd : file descriptor to write to
+ *   struct iovec *iov : buffers to write, modified after partial writes
+ *   size_t cnt : number of buffers
+ * 
+ * Returns:
+ *   int : 0 on success or -1 if writing failed
+ */
+int outbuf_writev(int fd, struct iovec *iov, size_t cnt);
+
+
+// Append n bytes from str
+static inline void outbuf_put(outbuf_t *out, const char *str, size_t n){
+	if(out->cap - out->len < n) outbuf_room(out, n);
+	memcpy(out->buf + out->len, str, n);
+	out->len += n;
+}
+
+// Two digit decimal strings of 00 to 99
+static const char OUT_DIGITS2[201] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+// Append x in decimal, converting two digits at a time
+static inline void outbuf_u64(outbuf_t *out, uint64_t x){
+	char tmp[20];
+	char *end = tmp + sizeof(tmp), *p = end;
+	for(; x >= 100; x /= 100){
+		p -= 2;
+		memcpy(p, OUT_DIGITS2 + 2 * (x % 100), 2);
+	}
+	if(x >= 10){
+		p -= 2;
+		memcpy(p, OUT_DIGITS2 + 2 * x, 2);
+	}else *--p = (char)('0' + x);
+	
+	outbuf_put(out, p, (size_t)(end - p));
+}
+
+
+// Append x as unsigned LEB128, 7 bits per byte starting from the lowest
+static inline void outbuf_varint(outbuf_t *out, uint64_t x){
+	if(out->cap - out->len < 10) outbuf_room(out, 10);
+	char *p = out->buf + out->len;
+	for(; x >= 0x80; x >>= 7) *p++ = (char)(x | 0x80);
+	*p++ = (char)x;
+	out->len = (size_t)(p - out->buf);
+}
+
+// Append x as an 8 byte little-endian word
+static inline void outbuf_u64le(outbuf_t *out, uint64_t x){
+	char bytes[8];
+	for(int k = 0; k < 8; k++, x >>= 8) bytes[k] = (char)x;
+	outbuf_put(out, bytes, 8);
+}
+
+#endif
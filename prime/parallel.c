@@ -0,0 +1,49 @@
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "parallel.h"
+
+// Work shared between the threads of a single call to par_for
+struct par_job_s{
+	size_t nchunks;
+	atomic_size_t next;  // Index of the next chunk to hand out
+	void (*fn)(size_t, void*);
+	void *arg;
+};
+
+unsigned int par_cpus(){
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (unsigned int)n : 1;
+}
+
+// Keep taking chunks until all of them have been handed out
+static void *par_worker(void *data){
+	struct par_job_s *job = data;
+	size_t chunk;
+	while((chunk = atomic_fetch_add(&job->next, 1)) < job->nchunks) job->fn(chunk, job->arg);
+	return NULL;
+}
+
+void par_for(size_t nchunks, unsigned int threads, void (*fn)(size_t chunk, void *arg), void *arg){
+	struct par_job_s job = {nchunks, 0, fn, arg};
+	if(threads > nchunks) threads = nchunks;
+	if(threads <= 1){
+		par_worker(&job);
+		return;
+	}
+	
+	// Start the helper threads, falling back to fewer if creation fails
+	pthread_t *tids = malloc(sizeof(pthread_t) * (threads - 1));
+	unsigned int t;
+	for(t = 0; t < threads - 1; t++){
+		if(pthread_create(tids + t, NULL, par_worker, &job)) break;
+	}
+	
+	// Calling thread works on chunks as well
+	par_worker(&job);
+	
+	while(t > 0) pthread_join(tids[--t], NULL);
+	free(tids);
+}
@@ -0,0 +1,34 @@
+#ifndef _PARALLEL_H
+#define _PARALLEL_H
+
+#include <stddef.h>
+
+/* Get the number of processors currently online
+ * 
+ * Returns:
+ *   unsigned int : number of online processors (at least 1)
+ */
+unsigned int par_cpus();
+
+/* Call fn once for each chunk index in [0, nchunks) using up to
+ * threads threads, including the calling thread. Chunks are handed
+ * out in ascending order from a shared counter so threads which
+ * finish early keep taking the remaining chunks. Returns after
+ * every chunk has been processed.
+ * 
+ * Usage:
+ *   void work(size_t chunk, void *arg){ ((int *)arg)[chunk] = chunk * chunk; }
+ *   int squares[100];
+ *   par_for(100, 8, work, squares);
+ * 
+ * Arguments:
+ *   size_t nchunks : number of chunks of work
+ *   unsigned int threads : maximum number of threads to use
+ *     NOTE: With threads <= 1 the chunks are processed in order
+ *       on the calling thread
+ *   void (*fn)(size_t, void*) : function processing a single chunk
+ *   void *arg : argument passed to every call of fn
+ */
+void par_for(size_t nchunks, unsigned int threads, void (*fn)(size_t chunk, void *arg), void *arg);
+
+#endif
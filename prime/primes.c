@@ -1,9 +1,65 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <math.h>
 
 #include "primes.h"
+#include "parallel.h"
+#include "mont.h"
+
+// Number of bits sieved at a time by the segmented sieve (32 KiB)
+#define SEG_BITS ((P_INT)1 << 18)
+// Number of bytes sieved at a time by the wheel sieve (32 KiB)
+#define W30_SEG_BYTES ((P_INT)1 << 15)
+// Least number of bytes of a wheel bit array given to a thread at a time
+#define W30_CHUNK_BYTES (8 * W30_SEG_BYTES)
+// Numbers covered by each window of the wheel sieve
+#define W30_SEG_NUMS (30 * W30_SEG_BYTES)
+// Sieving primes from this size on are kept in buckets by the window of their next multiple
+#define W30_BUCKET_MIN (W30_SEG_NUMS / 4)
+
+
+
+struct pwheel_s{
+	unsigned char *first_prime, *last_prime;
+	unsigned char *first_inc, *last_inc;
+	// Increment and number of the wheel at which trial division continues past the table
+	unsigned char *tdiv_inc;
+	P_INT tdiv_num;
+};
+
+// Odd prime with the numbers to test divisibility by it with a multiply and compare
+// p divides x exactly when x * inv (mod 2^64) <= lim as that's x / p for multiples of p
+struct tdiv_s{
+	P_INT inv;  // p^-1 (mod 2^64)
+	P_INT lim;  // floor((2^64 - 1) / p)
+	unsigned int p;
+};
+
+// Wheels of size 210, 2310 and 30030 and the trial division table from gen_wheels
+#include "wheel_tables.h"
+
+// Define often used simple wheels of size 6 and 30, TDIV_BOUND is a multiple of both
+static unsigned char W6_PRIMES[] = {2, 3}, W6_INCS[] = {4, 2};
+static struct pwheel_s WHL_6_s = {W6_PRIMES, W6_PRIMES + 1, W6_INCS, W6_INCS + 1, W6_INCS, TDIV_BOUND + 1};
+pwheel_t PWHEEL_6 = &WHL_6_s;
+
+static unsigned char W30_PRIMES[] = {2, 3, 5}, W30_INCS[] = {6, 4, 2, 4, 2, 4, 6, 2};
+static struct pwheel_s WHL_30_s = {W30_PRIMES, W30_PRIMES + 2, W30_INCS, W30_INCS + 7, W30_INCS, TDIV_BOUND + 1};
+pwheel_t PWHEEL_30 = &WHL_30_s;
+
+// Whether the table prime t divides x
+static inline int tdiv_divides(P_INT x, const struct tdiv_s *t){
+	return x * t->inv <= t->lim;
+}
+
+// Divide every power of the table prime t out of *x and return how many there were
+static inline int tdiv_remove(P_INT *x, const struct tdiv_s *t){
+	int pow = 0;
+	for(; *x * t->inv <= t->lim; pow++) *x *= t->inv;
+	return pow;
+}
 
 P_INT prime_sieve(unsigned char *primality, P_INT size){
 	P_INT n, i, count = 0;
@@ -21,67 +77,805 @@ P_INT prime_sieve(unsigned char *primality, P_INT size){
 	return count;
 }
 
+// Primes whose multiples prime_sieve_bs removes by copying a repeating pattern
+static const unsigned char BS_PRESIEVE[] = {2, 3, 5, 7, 11, 13};
+// Elements in the tiled block, which holds BIT_SIZE periods of 2 * 3 * 5 * 7 * 11 * 13 bits
+#define BS_PRESIEVE_ELEMS (2 * 3 * 5 * 7 * 11 * 13)
+
 // Bit array version
 P_INT prime_sieve_bs(bits_t primality, P_INT size){
-	P_INT n, i, count = 0;
-	memset(primality, 0xffff, byte_size(size));
+	if(size == 0) return 0;
+	P_INT n, i, k, elems = elem_size(size);
+	
+	// Cross off the small primes in the first period then tile it over the rest
+	P_INT period = elems < BS_PRESIEVE_ELEMS ? elems : BS_PRESIEVE_ELEMS, bits = period * BIT_SIZE;
+	memset(primality, 0xff, period * sizeof(BIT_TYPE));
+	for(k = 0; k < sizeof(BS_PRESIEVE); k++){
+		for(i = 0, n = BS_PRESIEVE[k]; i < bits; i += n) setbit(primality, i, 0);
+	}
+	for(i = period; i < elems; i += period){
+		memcpy(primality + i, primality, (elems - i < period ? elems - i : period) * sizeof(BIT_TYPE));
+	}
 	
-	setbit(primality, 0, 0);
+	// Pattern removed the small primes themselves along with 1
 	setbit(primality, 1, 0);
-	for(n = 2; n < size; n++){
+	for(k = 0; k < sizeof(BS_PRESIEVE) && BS_PRESIEVE[k] < size; k++) setbit(primality, BS_PRESIEVE[k], 1);
+	
+	for(n = BS_PRESIEVE[sizeof(BS_PRESIEVE) - 1] + 2; n * n < size; n += 2){
 		if(getbit(primality, n)){
+			for(i = n * n; i < size; i += 2 * n) setbit(primality, i, 0);
+		}
+	}
+	
+	return count_bits(primality, 0, size);
+}
+
+
+
+// Integer square root, floor(sqrt(x))
+static P_INT isqrt(P_INT x){
+	P_INT r = (P_INT)sqrtl((long double)x);
+	// Correct for rounding errors in the floating point root
+	while(r > 0xffffffffULL || r * r > x) r--;
+	while(r < 0xffffffffULL && (r + 1) * (r + 1) <= x) r++;
+	return r;
+}
+
+/* Cross off the multiples of each prime in primes up to offset to
+ * The bit for offset i is stored at index i - base of bs
+ * and next[k] holds the offset of the next multiple of primes[k]
+ * which is advanced past to for the following window
+ */
+static void sieve_window(bits_t bs, P_INT base, P_INT to, const uint32_t *primes, size_t len, P_INT *next){
+	for(size_t k = 0; k < len; k++){
+		P_INT i = next[k], p = primes[k];
+		for(; i < to; i += p) setbit(bs, i - base, 0);
+		next[k] = i;
+	}
+}
+
+// Collect all primes up to limit into a newly allocated array
+static uint32_t *sieving_primes(P_INT limit, size_t *len){
+	*len = 0;
+	if(limit < 2) return NULL;
+	
+	// Find primes up to sqrt(limit) with a simple sieve
+	P_INT n, root = isqrt(limit);
+	unsigned char *small = malloc(root + 1);
+	prime_sieve(small, root + 1);
+	
+	size_t k, nsmall = 0;
+	uint32_t *sprimes = malloc(sizeof(uint32_t) * (root + 1));
+	for(n = 2; n <= root; n++) if(small[n]) sprimes[nsmall++] = n;
+	free(small);
+	
+	// Offsets are measured from 2
+	P_INT *next = malloc(sizeof(P_INT) * (nsmall + 1));
+	for(k = 0; k < nsmall; k++) next[k] = (P_INT)sprimes[k] * sprimes[k] - 2;
+	
+	size_t cap = 1024;
+	uint32_t *primes = malloc(sizeof(uint32_t) * cap);
+	bits_t window = malloc(byte_size(SEG_BITS));
+	
+	// Sieve [2, limit] one window at a time collecting the primes
+	P_INT lo, hi, size = limit - 1;
+	for(lo = 0; lo < size; lo += SEG_BITS){
+		hi = size - lo > SEG_BITS ? lo + SEG_BITS : size;
+		memset(window, 0xff, byte_size(SEG_BITS));
+		sieve_window(window, lo, hi, sprimes, nsmall, next);
+		
+		for(n = lo; n < hi; n++) if(getbit(window, n - lo)){
+			if(*len >= cap) primes = realloc(primes, sizeof(uint32_t) * (cap <<= 1));
+			primes[(*len)++] = n + 2;
+		}
+	}
+	
+	free(window);
+	free(next);
+	free(sprimes);
+	return primes;
+}
+
+// Segmented version
+P_INT prime_sieve_seg(bits_t primality, P_INT lower, P_INT upper){
+	if(upper < lower) return 0;
+	P_INT i, size = upper - lower + 1, count = 0;
+	memset(primality, 0xff, byte_size(size));
+	
+	// 0 and 1 are not prime
+	for(i = lower; i < 2 && i <= upper; i++) setbit(primality, i - lower, 0);
+	
+	size_t k, len;
+	uint32_t *primes = sieving_primes(isqrt(upper), &len);
+	
+	// Find the offset of the first multiple of each prime to cross off
+	P_INT *next = malloc(sizeof(P_INT) * (len + 1));
+	for(k = 0; k < len; k++){
+		P_INT p = primes[k], m = p * p;
+		if(m < lower) m = lower + (p - lower % p) % p;
+		next[k] = m - lower;
+	}
+	
+	// Sieve a window at a time so the crossing off stays in cache
+	P_INT lo, hi;
+	for(lo = 0; lo < size; lo += SEG_BITS){
+		hi = size - lo > SEG_BITS ? lo + SEG_BITS : size;
+		sieve_window(primality, 0, hi, primes, len, next);
+		count += count_bits(primality, lo, hi);
+	}
+	
+	free(next);
+	free(primes);
+	return count;
+}
+
+// Primes from 7 whose multiples the wheel sieve removes with a repeating pattern
+static const unsigned char W30_PRESIEVE[] = {7, 11, 13, 17, 19};
+// Bytes of wheel bit array in one period of the pattern
+#define W30_PRESIEVE_BYTES (7 * 11 * 13 * 17 * 19)
+
+// Build the wheel bit array of the numbers in [0, 30 * W30_PRESIEVE_BYTES)
+// without the multiples of the primes in W30_PRESIEVE
+static unsigned char *w30_presieve_pattern(){
+	unsigned char *pattern = malloc(W30_PRESIEVE_BYTES);
+	memset(pattern, 0xff, W30_PRESIEVE_BYTES);
+	
+	for(size_t k = 0; k < sizeof(W30_PRESIEVE); k++){
+		P_INT p = W30_PRESIEVE[k], m = p;
+		for(unsigned char w = 0; m < 30 * W30_PRESIEVE_BYTES; w = (w + 1) & 7){
+			clearbit30(pattern, m);
+			m += p * W30_INCS[w];
+		}
+	}
+	return pattern;
+}
+
+// Multiple of a large sieving prime waiting for its window
+struct w30_hit_s{
+	uint32_t p;
+	uint32_t pos;  // Offset of the multiple within its window times 8 plus the wheel index of its cofactor
+};
+
+// Hits for a single window
+struct w30_bucket_s{
+	struct w30_hit_s *hits;
+	size_t len, cap;
+};
+
+static inline void bucket_push(struct w30_bucket_s *b, uint32_t p, uint32_t pos){
+	if(b->len == b->cap) b->hits = realloc(b->hits, sizeof(struct w30_hit_s) * (b->cap = b->cap ? 2 * b->cap : 64));
+	b->hits[b->len++] = (struct w30_hit_s){p, pos};
+}
+
+/* Sieve bytes [from, to) of a wheel bit array whose byte 0 starts at base
+ * using the primes from the array primes which are all at least 7
+ * If pattern is given it is combined with each window first and
+ * primes should start after the last of W30_PRESIEVE
+ * Primes larger than W30_BUCKET_MIN hit few windows so rather than
+ * visiting each of them in every window they wait in the bucket of
+ * the window holding their next multiple
+ * Returns the number of bits set in those bytes afterwards
+ */
+static P_INT sieve_w30_range(unsigned char *primality, P_INT base, P_INT from, P_INT to, const uint32_t *primes, size_t len, const unsigned char *pattern){
+	// Work relative to the first byte in the range
+	primality += from;
+	P_INT lower = base + 30 * from, size = to - from, count = 0;
+	
+	// Primes whose first multiple is past the end of the range are dropped
+	size_t k, small;
+	for(small = 0; small < len && primes[small] < W30_BUCKET_MIN; small++);
+	P_INT nwin = (size + W30_SEG_BYTES - 1) / W30_SEG_BYTES;
+	struct w30_bucket_s *buckets = small < len ? calloc(nwin, sizeof(struct w30_bucket_s)) : NULL;
+	
+	// Track the offset of the next multiple p * q of each prime and the
+	// index of q in the wheel so only q coprime to 30 are visited
+	P_INT *next = malloc(sizeof(P_INT) * (small + 1));
+	unsigned char *whl_idx = malloc(small + 1);
+	for(k = 0; k < len; k++){
+		P_INT p = primes[k], q = lower / p + (lower % p != 0);
+		if(q < p) q = p;
+		while(W30_BIT[q % 30] == 8) q++;
+		
+		P_INT m = p * q - lower;
+		unsigned char w = W30_BIT[q % 30];
+		if(k < small){
+			next[k] = m;
+			whl_idx[k] = w;
+		}else if(m / W30_SEG_NUMS < nwin){
+			bucket_push(buckets + m / W30_SEG_NUMS, p, (uint32_t)(m % W30_SEG_NUMS) << 3 | w);
+		}
+	}
+	
+	// Sieve a window at a time so the crossing off stays in cache
+	P_INT lo, hi, win;
+	for(lo = 0, win = 0; lo < size; lo += W30_SEG_BYTES, win++){
+		hi = size - lo > W30_SEG_BYTES ? lo + W30_SEG_BYTES : size;
+		
+		// Remove the multiples of the pattern primes by combining with the pattern at the same phase
+		// Combined rather than copied so bits already cleared outside the range stay cleared
+		if(pattern){
+			P_INT i = lo, phase = (base / 30 + from + lo) % W30_PRESIEVE_BYTES;
+			while(i < hi){
+				P_INT j, n = hi - i < W30_PRESIEVE_BYTES - phase ? hi - i : W30_PRESIEVE_BYTES - phase;
+				for(j = 0; j < n; j++) primality[i + j] &= pattern[phase + j];
+				i += n;
+				phase = 0;
+			}
+		}
+		
+		P_INT end = 30 * hi;
+		for(k = 0; k < small; k++){
+			P_INT m = next[k], p = primes[k];
+			unsigned char w = whl_idx[k];
+			for(; m < end; w = (w + 1) & 7){
+				clearbit30(primality, m);
+				m += p * W30_INCS[w];
+			}
+			next[k] = m;
+			whl_idx[k] = w;
+		}
+		
+		// Cross off the hits of the large primes in this window and move them to the bucket of their next one
+		if(buckets){
+			struct w30_bucket_s *b = buckets + win;
+			unsigned char *window = primality + lo;
+			P_INT limit = 30 * (hi - lo);
+			for(size_t h = 0; h < b->len; h++){
+				P_INT p = b->hits[h].p, m = b->hits[h].pos >> 3;
+				unsigned char w = b->hits[h].pos & 7;
+				for(; m < limit; w = (w + 1) & 7){
+					clearbit30(window, m);
+					m += p * W30_INCS[w];
+				}
+				
+				// Past the end of the range once the next multiple isn't in a later window
+				P_INT to_win = win + m / W30_SEG_NUMS;
+				if(to_win > win && to_win < nwin) bucket_push(buckets + to_win, (uint32_t)p, (uint32_t)(m % W30_SEG_NUMS) << 3 | w);
+			}
+			free(b->hits);
+		}
+		
+		count += count_bits30(primality + lo, hi - lo);
+	}
+	
+	free(buckets);
+	free(whl_idx);
+	free(next);
+	return count;
+}
+
+// Work shared by the threads sieving a wheel bit array
+struct w30_job_s{
+	unsigned char *primality;
+	P_INT base, size;  // First number and size in bytes of the bit array
+	const uint32_t *primes;
+	size_t len;
+	const unsigned char *pattern;  // Pattern for the primes in W30_PRESIEVE or NULL
+	P_INT chunk;  // Size in bytes of each chunk
+	P_INT *counts;  // Number of primes found in each chunk
+};
+
+static void sieve_w30_chunk(size_t chunk, void *arg){
+	struct w30_job_s *job = arg;
+	P_INT from = chunk * job->chunk;
+	P_INT to = job->size - from > job->chunk ? from + job->chunk : job->size;
+	job->counts[chunk] = sieve_w30_range(job->primality, job->base, from, to, job->primes, job->len, job->pattern);
+}
+
+// Wheel compressed version
+P_INT prime_sieve_w30(unsigned char *primality, P_INT lower, P_INT upper){
+	return prime_sieve_w30_mt(primality, lower, upper, 1);
+}
+
+// Multi-threaded wheel compressed version
+P_INT prime_sieve_w30_mt(unsigned char *primality, P_INT lower, P_INT upper, unsigned int threads){
+	if(upper < lower) return 0;
+	P_INT base = lower - lower % 30, size = w30_size(upper - base + 1);
+	P_INT i, count = 0;
+	memset(primality, 0xff, size);
+	
+	// Count the wheel primes and remove 1 along with everything outside of the range
+	unsigned char *wp;
+	for_primes_w(wp, PWHEEL_30) count += lower <= *wp && *wp <= upper;
+	for(i = base; i < lower; i++) if(W30_BIT[i % 30] < 8) clearbit30(primality, i - base);
+	for(i = upper - base + 1; i < 30 * size; i++) if(W30_BIT[i % 30] < 8) clearbit30(primality, i);
+	if(lower <= 1 && upper >= 1) clearbit30(primality, 1);
+	
+	// Skip the primes 2, 3, and 5 which the wheel already removes
+	size_t k, len;
+	uint32_t *primes = sieving_primes(isqrt(upper), &len);
+	for(k = 0; k < len && primes[k] <= 5; k++);
+	
+	// On ranges longer than its period the next few primes are removed with a pattern
+	unsigned char *pattern = NULL;
+	if(size >= W30_PRESIEVE_BYTES){
+		pattern = w30_presieve_pattern();
+		for(; k < len && primes[k] <= W30_PRESIEVE[sizeof(W30_PRESIEVE) - 1]; k++);
+	}
+	
+	// Chunks are independent so they may be sieved by separate threads
+	// Each chunk finds the first multiple of every prime so only split the range as much as the threads need
+	P_INT chunk_bytes = (size / threads + W30_SEG_BYTES) / W30_SEG_BYTES * W30_SEG_BYTES;
+	if(chunk_bytes < W30_CHUNK_BYTES) chunk_bytes = W30_CHUNK_BYTES;
+	size_t chunk, nchunks = (size + chunk_bytes - 1) / chunk_bytes;
+	struct w30_job_s job = {primality, base, size, primes + k, len - k, pattern, chunk_bytes, malloc(sizeof(P_INT) * nchunks)};
+	par_for(nchunks, threads, sieve_w30_chunk, &job);
+	for(chunk = 0; chunk < nchunks; chunk++) count += job.counts[chunk];
+	
+	// The pattern also removed the pattern primes themselves
+	for(k = 0; pattern && k < sizeof(W30_PRESIEVE); k++){
+		if(lower <= W30_PRESIEVE[k] && W30_PRESIEVE[k] <= upper){
+			primality[(W30_PRESIEVE[k] - base) / 30] |= 1 << W30_BIT[W30_PRESIEVE[k] % 30];
 			count++;
-			for(i = n + n; i < size; i += n) setbit(primality, i, 0);
 		}
 	}
 	
+	free(pattern);
+	free(job.counts);
+	free(primes);
 	return count;
 }
 
 
+// Bit b of every byte in a word of wheel bit array
+#define W30_LANES 0x0101010101010101ULL
+// Bits of the residues 11, 17 and 29 whose twin is the next bit up
+#define W30_TWIN_BITS 0x9494949494949494ULL
 
-struct pwheel_s{
-	unsigned char *first_prime, *last_prime;
-	unsigned char *first_inc, *last_inc;
+// Read 8 bytes of a wheel bit array as a word with byte 0 in the low bits
+static inline uint64_t load_w30_word(const unsigned char *bs){
+	uint64_t w;
+	memcpy(&w, bs, sizeof(w));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	w = __builtin_bswap64(w);
+#endif
+	return w;
+}
+
+// Whether x <= upper is marked prime in the wheel bit array, x must be at least the lower bound sieved
+static int w30_isprime(const unsigned char *primality, P_INT base, P_INT upper, P_INT x){
+	if(x < 7) return x == 2 || x == 3 || x == 5;
+	return x <= upper && getbit30(primality, x - base);
+}
+
+// Whether p starts a match of the pattern, checking each member one at a time
+static int w30_tuple_at(const unsigned char *primality, P_INT base, P_INT upper, P_INT p, const w30_tuple_t *t){
+	for(size_t j = 0; j < t->len; j++){
+		if(t->offs[j] > upper - p || !w30_isprime(primality, base, upper, p + t->offs[j])) return 0;
+	}
+	return 1;
+}
+
+int w30_tuple_init(w30_tuple_t *t, const P_INT *offs, size_t len){
+	if(len < 1 || len > W30_TUPLE_MAX || offs[0] != 0) return -1;
+	for(size_t j = 1; j < len; j++) if(offs[j] <= offs[j - 1]) return -1;
+	
+	t->len = len;
+	memcpy(t->offs, offs, len * sizeof(P_INT));
+	t->bits = 0;
+	for(int b = 0; b < 8; b++){
+		int ok = 1;
+		for(size_t j = 0; j < len; j++){
+			P_INT x = W30_RESIDUE[b] + offs[j];
+			ok &= W30_BIT[x % 30] < 8;
+			t->ahead[b][j] = x / 30;
+			t->bit[b][j] = W30_BIT[x % 30];
+		}
+		if(ok) t->bits |= 1 << b;
+	}
+	return 0;
+}
+
+P_INT w30_tuples(const unsigned char *primality, P_INT base, P_INT upper, P_INT from, P_INT to, const w30_tuple_t *t, void (*found)(P_INT p, void *arg), void *arg){
+	P_INT count = 0, x;
+	if(to > upper) to = upper;
+	
+	// Matches starting below 7 may include 2, 3, or 5 which have no bits
+	for(x = from; x < 7 && x <= to; x++) if(w30_tuple_at(primality, base, upper, x, t)){
+		if(found) found(x, arg);
+		count++;
+	}
+	if(x > to || !t->bits) return count;
+	
+	int twins = t->len == 2 && t->offs[1] == 2;
+	P_INT size = w30_size(upper - base + 1), ahead = t->ahead[7][t->len - 1];
+	for(P_INT k = (x - base) / 30 / 8 * 8; k <= (to - base) / 30; k += 8){
+		uint64_t hits = 0;
+		if(k + ahead + 16 <= size){
+			uint64_t w = load_w30_word(primality + k);
+			if(twins){
+				// Each twin is the next bit up, or bit 0 of the next byte after residue 29
+				hits = w & (w >> 1 | load_w30_word(primality + k + 8) << 63) & W30_TWIN_BITS;
+			}else{
+				// Line the bit of every member up with the bit of the first in each byte
+				for(int b = 0; b < 8; b++){
+					if(!(t->bits >> b & 1)) continue;
+					uint64_t m = w & W30_LANES << b;
+					for(size_t j = 1; j < t->len && m; j++){
+						uint64_t v = load_w30_word(primality + k + t->ahead[b][j]);
+						int shift = t->bit[b][j] - b;
+						m &= shift >= 0 ? v >> shift : v << -shift;
+					}
+					hits |= m;
+				}
+			}
+		}else{
+			// Near the end of the bit array check each candidate on its own
+			for(int pos = 0; pos < 64 && k + pos / 8 < size; pos++){
+				if(t->bits >> (pos % 8) & 1 && w30_tuple_at(primality, base, upper, base + 30 * (k + pos / 8) + W30_RESIDUE[pos % 8], t))
+					hits |= 1ULL << pos;
+			}
+		}
+		
+		// Whole words inside the range are only counted when no matches are needed
+		if(!found && base + 30 * k >= x && (to - base) / 30 >= k + 8){
+			count += __builtin_popcountll(hits);
+			continue;
+		}
+		for(; hits; hits &= hits - 1){
+			int pos = __builtin_ctzll(hits);
+			P_INT p = base + 30 * (k + pos / 8) + W30_RESIDUE[pos % 8];
+			if(p < x || p > to) continue;
+			if(found) found(p, arg);
+			count++;
+		}
+	}
+	return count;
+}
+
+// State of w30_gaps while stepping from one prime to the next
+struct w30_gaps_s{
+	P_INT prev, max;
+	void (*record)(P_INT p, P_INT q, void *arg);
+	void *arg;
 };
 
-// Define often used simple wheels of size 6 and 30
-static unsigned char W6_PRIMES[] = {2, 3}, W6_INCS[] = {4, 2};
-static struct pwheel_s WHL_6_s = {W6_PRIMES, W6_PRIMES + 1, W6_INCS, W6_INCS + 1};
-pwheel_t PWHEEL_6 = &WHL_6_s;
+// Move on to prime q reporting the gap before it if it's the largest yet
+static inline void w30_gap_step(struct w30_gaps_s *g, P_INT q){
+	if(g->prev && q - g->prev > g->max){
+		g->max = q - g->prev;
+		if(g->record) g->record(g->prev, q, g->arg);
+	}
+	g->prev = q;
+}
 
-static unsigned char W30_PRIMES[] = {2, 3, 5}, W30_INCS[] = {6, 4, 2, 4, 2, 4, 6, 2};
-static struct pwheel_s WHL_30_s = {W30_PRIMES, W30_PRIMES + 2, W30_INCS, W30_INCS + 7};
-pwheel_t PWHEEL_30 = &WHL_30_s;
+P_INT w30_gaps(const unsigned char *primality, P_INT base, P_INT from, P_INT to, P_INT min_gap, P_INT *first, P_INT *last, void (*record)(P_INT p, P_INT q, void *arg), void *arg){
+	struct w30_gaps_s g = {0, min_gap, record, arg};
+	P_INT x;
+	*first = 0;
+	
+	for(x = from; x < 7 && x <= to; x++) if(x == 2 || x == 3 || x == 5){
+		if(!*first) *first = x;
+		w30_gap_step(&g, x);
+	}
+	if(x <= to){
+		// Walk the set bits a word at a time skipping those outside of [x, to] in the end words
+		P_INT k, j, kend = (to - base) / 30 + 1;
+		for(k = (x - base) / 30; k < kend; k += 8){
+			uint64_t w;
+			if(k + 8 <= kend) w = load_w30_word(primality + k);
+			else for(w = 0, j = k; j < kend; j++) w |= (uint64_t)primality[j] << 8 * (j - k);
+			
+			for(; w; w &= w - 1){
+				int pos = __builtin_ctzll(w);
+				P_INT q = base + 30 * (k + pos / 8) + W30_RESIDUE[pos % 8];
+				if(q < x || q > to) continue;
+				if(!*first) *first = q;
+				w30_gap_step(&g, q);
+			}
+		}
+	}
+	
+	*last = g.prev;
+	return g.max;
+}
+
+
+// Product modulo the Mersenne prime AGG_HASH_MOD of a, b < AGG_HASH_MOD
+static inline P_INT mulmod_m61(P_INT a, P_INT b){
+	unsigned __int128 t = (unsigned __int128)a * b;
+	P_INT r = ((P_INT)t & AGG_HASH_MOD) + (P_INT)(t >> 61);
+	r = (r & AGG_HASH_MOD) + (r >> 61);
+	return r >= AGG_HASH_MOD ? r - AGG_HASH_MOD : r;
+}
+
+// Sum of a, b < mod modulo mod without overflowing
+static inline P_INT addmod(P_INT a, P_INT b, P_INT mod){
+	return a >= mod - b ? a - (mod - b) : a + b;
+}
+
+void prime_agg_init(prime_agg_t *agg, P_INT mod){
+	agg->mod = mod;
+	agg->hist = mod <= AGG_HIST_MAX ? malloc(mod * sizeof(P_INT)) : NULL;
+	prime_agg_clear(agg);
+}
+
+void prime_agg_clear(prime_agg_t *agg){
+	agg->count = agg->first = agg->last = 0;
+	agg->sum = 0;
+	agg->sum_sq = agg->hash = 0;
+	agg->hash_pow = 1;
+	if(agg->hist) memset(agg->hist, 0, agg->mod * sizeof(P_INT));
+}
+
+void prime_agg_add(prime_agg_t *agg, P_INT p){
+	if(!agg->count++) agg->first = p;
+	agg->last = p;
+	agg->sum += p;
+	
+	// Squares of residues below 2^32 fit in a word
+	P_INT r = p % agg->mod;
+	P_INT sq = r >> 32 ? (P_INT)((unsigned __int128)r * r % agg->mod) : r * r % agg->mod;
+	agg->sum_sq = addmod(agg->sum_sq, sq, agg->mod);
+	if(agg->hist) agg->hist[r]++;
+	
+	agg->hash = addmod(mulmod_m61(agg->hash, AGG_HASH_BASE), p % AGG_HASH_MOD, AGG_HASH_MOD);
+	agg->hash_pow = mulmod_m61(agg->hash_pow, AGG_HASH_BASE);
+}
+
+void prime_agg_join(prime_agg_t *agg, const prime_agg_t *next){
+	if(!next->count) return;
+	if(!agg->count) agg->first = next->first;
+	agg->last = next->last;
+	agg->count += next->count;
+	agg->sum += next->sum;
+	agg->sum_sq = addmod(agg->sum_sq, next->sum_sq, agg->mod);
+	for(P_INT r = 0; agg->hist && r < agg->mod; r++) agg->hist[r] += next->hist[r];
+	
+	// Every prime of agg is followed by the primes of next
+	agg->hash = addmod(mulmod_m61(agg->hash, next->hash_pow), next->hash, AGG_HASH_MOD);
+	agg->hash_pow = mulmod_m61(agg->hash_pow, next->hash_pow);
+}
+
+void prime_agg_free(prime_agg_t *agg){
+	free(agg->hist);
+	agg->hist = NULL;
+}
+
+void w30_aggregate(const unsigned char *primality, P_INT base, P_INT from, P_INT to, prime_agg_t *agg){
+	P_INT x, k, j, kend;
+	for(x = from; x < 7 && x <= to; x++) if(x == 2 || x == 3 || x == 5) prime_agg_add(agg, x);
+	if(x > to) return;
+	
+	// Walk the set bits a word at a time skipping those outside of [x, to] in the end words
+	kend = (to - base) / 30 + 1;
+	for(k = (x - base) / 30; k < kend; k += 8){
+		uint64_t w;
+		if(k + 8 <= kend) w = load_w30_word(primality + k);
+		else for(w = 0, j = k; j < kend; j++) w |= (uint64_t)primality[j] << 8 * (j - k);
+		
+		for(; w; w &= w - 1){
+			int pos = __builtin_ctzll(w);
+			P_INT p = base + 30 * (k + pos / 8) + W30_RESIDUE[pos % 8];
+			if(p >= x && p <= to) prime_agg_add(agg, p);
+		}
+	}
+}
+
+
+
+
+// Bytes of wheel bit array sieved by a prime iterator at a time
+#define ITER_BYTES (1 << 12)
+// Numbers covered by each window of a prime iterator
+#define ITER_NUMS (30ULL * ITER_BYTES)
+// Largest prime an iterator sieves with, past its square what survives is checked with Miller-Rabin
+#define ITER_MAX_SIEVING (1 << 20)
+
+// Sieve window win of an iterator and collect its primes
+static void iter_fill(prime_iter_t *it, P_INT win){
+	// The last window stops at the largest 64-bit number
+	P_INT lo = win * ITER_NUMS, hi = lo + (ITER_NUMS - 1);
+	if(hi < lo) hi = (P_INT)-1;
+	P_INT k, bytes = w30_size(hi - lo + 1), root = isqrt(hi);
+	
+	// Collect more sieving primes once the window passes the square of the largest
+	if(root > it->sieving_limit && it->sieving_limit < ITER_MAX_SIEVING){
+		P_INT limit = 2 * it->sieving_limit;
+		if(limit < root) limit = root;
+		if(limit > ITER_MAX_SIEVING) limit = ITER_MAX_SIEVING;
+		free(it->sieving);
+		it->sieving = sieving_primes(limit, &it->sieving_len);
+		it->sieving_limit = limit;
+	}
+	
+	// Use the primes above 5 up to the root of the window
+	size_t first, last = it->sieving_len;
+	for(first = 0; first < last && it->sieving[first] <= 5; first++);
+	for(size_t l = first; l < last;){
+		size_t mid = l + (last - l) / 2;
+		if(it->sieving[mid] <= root) l = mid + 1;
+		else last = mid;
+	}
+	
+	memset(it->bs, 0xff, bytes);
+	sieve_w30_range(it->bs, lo, 0, bytes, it->sieving + first, last - first, NULL);
+	
+	it->len = 0;
+	if(win == 0){
+		clearbit30(it->bs, 1);
+		it->primes[it->len++] = 2;
+		it->primes[it->len++] = 3;
+		it->primes[it->len++] = 5;
+	}
+	for(k = 0; k < bytes; k++){
+		for(unsigned int bits = it->bs[k]; bits; bits &= bits - 1){
+			P_INT x = lo + 30 * k + W30_RESIDUE[__builtin_ctz(bits)];
+			if(x < lo) break;  // Past the largest 64-bit number
+			it->primes[it->len++] = x;
+		}
+	}
+	
+	// Remove the composites left by sieving with only part of the primes up to the root
+	if(root > it->sieving_limit){
+		uint8_t *res = malloc(it->len);
+		is_prime_mr_batch(it->primes, it->len, res);
+		size_t len = 0;
+		for(k = 0; k < it->len; k++) if(res[k]) it->primes[len++] = it->primes[k];
+		it->len = len;
+		free(res);
+	}
+	it->win = win;
+}
+
+void prime_iter_init(prime_iter_t *it, P_INT start){
+	it->bs = malloc(ITER_BYTES);
+	it->primes = malloc(sizeof(P_INT) * (8 * ITER_BYTES + 3));
+	it->sieving = NULL;
+	it->sieving_len = 0;
+	it->sieving_limit = 0;
+	
+	iter_fill(it, start / ITER_NUMS);
+	for(it->pos = 0; it->pos < it->len && it->primes[it->pos] < start; it->pos++);
+}
+
+P_INT prime_iter_next(prime_iter_t *it){
+	while(it->pos == it->len){
+		// Stay at the end after the last window
+		if(it->win == ((P_INT)-1) / ITER_NUMS) return 0;
+		iter_fill(it, it->win + 1);
+		it->pos = 0;
+	}
+	return it->primes[it->pos++];
+}
+
+P_INT prime_iter_prev(prime_iter_t *it){
+	while(it->pos == 0){
+		if(it->win == 0) return 0;
+		iter_fill(it, it->win - 1);
+		it->pos = it->len;
+	}
+	return it->primes[--it->pos];
+}
+
+void prime_iter_free(prime_iter_t *it){
+	free(it->bs);
+	free(it->primes);
+	free(it->sieving);
+	it->bs = NULL;
+	it->primes = NULL;
+	it->sieving = NULL;
+}
+
+
+// Quotient floor(n / d) using a double which is exact for n < 2^53
+static inline P_INT div_fast(P_INT n, P_INT d){
+	return n < ((P_INT)1 << 53) ? (P_INT)((double)n / (double)d) : n / d;
+}
+
+// Combinatorial prime counting using Lucy_Hedgehog's method
+// Only odd numbers are tracked and after sieving by each prime the
+// values of x / i are only kept for the i which are still unsieved (rough)
+P_INT prime_count(P_INT x){
+	if(x < 3) return x == 2;
+	P_INT r = isqrt(x);
+	uint32_t i, k, p, s = (r + 1) / 2;
+	
+	// small[i] counts odd numbers in [3, 2 * i + 1] not yet removed
+	// large[k] counts the same in [3, x / rough[k]]
+	uint32_t *small = malloc(sizeof(uint32_t) * s);
+	uint32_t *rough = malloc(sizeof(uint32_t) * s);
+	P_INT *large = calloc(s, sizeof(P_INT));  // Zeroed as the compiler can't see that s > 0
+	unsigned char *skip = calloc(r + 1, 1);
+	if(!small || !rough || !large || !skip){
+		free(skip);
+		free(large);
+		free(rough);
+		free(small);
+		return 0;
+	}
+	for(i = 0; i < s; i++){
+		small[i] = i;
+		rough[i] = 2 * i + 1;
+		large[i] = (x / (2 * i + 1) - 1) / 2;
+	}
+	
+	// Number of odd primes sieved so far
+	uint32_t pc = 0;
+	for(p = 3; p <= r; p += 2){
+		if(skip[p]) continue;
+		P_INT p2 = (P_INT)p * p;
+		if(p2 * p2 > x) break;
+		
+		// Mark p and its odd multiples as no longer rough
+		skip[p] = 1;
+		for(P_INT m = p2; m <= r; m += 2 * p) skip[m] = 1;  // 64-bit as m passes 2^32 when r is near it
+		
+		// Remove the multiples of p from each large count and drop the
+		// i which have become non-rough compacting the arrays
+		uint32_t ns = 0;
+		for(k = 0; k < s; k++){
+			uint32_t j = rough[k];
+			if(skip[j]) continue;
+			P_INT d = (P_INT)j * p;
+			P_INT sub = d <= r ? large[small[d >> 1] - pc] : small[(div_fast(x, d) - 1) >> 1];
+			large[ns] = large[k] - sub + pc;
+			rough[ns++] = j;
+		}
+		s = ns;
+		
+		// Update small counts from the top down, all i in a run of
+		// p share the same quotient so avoid a division for each
+		uint32_t j = ((r / p) - 1) | 1;
+		for(i = (r - 1) >> 1; j >= p; j -= 2){
+			uint32_t c = small[j >> 1] - pc, e = (j * p) >> 1;
+			for(; i >= e; i--) small[i] -= c;
+		}
+		pc++;
+	}
+	
+	// Remaining primes are greater than x^(1/4) so the numbers left
+	// in the counts have at most two prime factors, remove the
+	// products of two primes (Meissel's correction for phi)
+	P_INT count = large[0] + (P_INT)(((long long)s + 2 * ((long long)pc - 1)) * (s - 1) / 2);
+	for(k = 1; k < s; k++) count -= large[k];
+	for(i = 1; i < s; i++){
+		P_INT q = rough[i], m = x / q;
+		uint32_t e = small[(m / q - 1) >> 1] - pc;
+		if(e < i + 1) break;
+		
+		P_INT t = 0;
+		for(k = i + 1; k <= e; k++) t += small[(div_fast(m, rough[k]) - 1) >> 1];
+		count += t - (P_INT)(e - i) * (pc + i - 1);
+	}
+	
+	free(skip);
+	free(large);
+	free(rough);
+	free(small);
+	
+	// Add back the prime 2
+	return count + 1;
+}
 
 
 
 pwheel_t make_pwheel(unsigned char max){
 	pwheel_t whl = malloc(sizeof(struct pwheel_s));
 	
-	char primality[max];
+	unsigned char *primality = malloc(max);
 	unsigned char cnt = (unsigned char)prime_sieve(primality, max);
 	whl->first_prime = malloc(sizeof(unsigned char) * cnt);
 	whl->last_prime = whl->first_prime + cnt - 1;
 	
 	// Calculate product of primes
 	cnt = 0; // Use cnt to index through primes
-	P_INT product = 1;
-	int n;
+	P_INT product = 1, n;
 	for(n = 0; n < max; n++){
 		if(primality[n]){
 			whl->first_prime[cnt++] = n;
 			product *= n;
 		}
 	}
+	free(primality);
 	
 	// Create buffer to record coprime elements
 	char *buffer = malloc(sizeof(char) * product);
-	for(n = 0; n < product; n++) buffer[n] = 1;
+	memset(buffer, 1, product);
 	buffer[0] = 0;
 	
 	// Find the coprime elements
-	int inc_count = product - 1;
+	P_INT inc_count = product - 1;
 	unsigned char *pr;
 	for(pr = whl->first_prime; pr <= whl->last_prime; pr++){
 		for(n = *pr; n < product; n += *pr){
@@ -114,6 +908,11 @@ pwheel_t make_pwheel(unsigned char max){
 	
 	free(buffer);
 	
+	// Find the first number of the wheel above the trial division table once rather than per call
+	whl->tdiv_inc = whl->first_inc;
+	whl->tdiv_num = TDIV_BOUND / product * product + 1;
+	while(whl->tdiv_num <= TDIV_BOUND) nextnum_w(&whl->tdiv_inc, &whl->tdiv_num, whl);
+	
 	return whl;
 }
 
@@ -146,173 +945,826 @@ void nextnum_w(unsigned char **inc, P_INT *x, pwheel_t whl){
 }
 
 
+// First entry of the trial division table above the largest wheel prime, or the end of the table
+static inline const struct tdiv_s *tdiv_after_w(pwheel_t whl){
+	const struct tdiv_s *t = TDIV_PRIMES;
+	while(t < TDIV_PRIMES + TDIV_LEN && t->p <= *whl->last_prime) t++;
+	return t;
+}
+
 
 
 int is_prime_w(P_INT x, pwheel_t whl){
 	if(x <= 1) return 0;
 	
-	// Iterate through primes to check
+	// Iterate through primes to check, all but 2 are tested with the trial division table
 	unsigned char *p;  // Pointer to prime
+	const struct tdiv_s *t = TDIV_PRIMES;
 	for_primes_w(p, whl){
 		if(x == *p) return 1;
-		if(x % *p == 0) return 0;
+		if(*p == 2 ? !(x & 1) : tdiv_divides(x, t++)) return 0;
+	}
+	
+	// Only the primes of the table need checking up to its bound
+	for(; t < TDIV_PRIMES + TDIV_LEN; t++){
+		if((P_INT)t->p * t->p > x) return 1;
+		if(tdiv_divides(x, t)) return 0;
 	}
 	
-	// Iterate through increments to check
-	// Use uchr as increment indexer
-	P_INT i = 1;
+	// Iterate through increments past the table to check, comparing with the quotient as i^2 can overflow
+	P_INT i;
 	unsigned char *inc;  // Pointer to increment
-	for_nums_w(inc, i, whl, i * i <= x){
-		if(x != i && x % i == 0) return 0;
+	for(inc = whl->tdiv_inc, i = whl->tdiv_num; i <= x / i; nextnum_w(&inc, &i, whl)){
+		if(x % i == 0) return 0;
 	}
 	return 1;
 }
 
-// When called repeatedly it will return each prime factor
-// in ascending order along with its corresponding power.
-// Returns 0 if no number given to factor or the prior number has been completely factored
-P_INT factorize_w(P_INT x, pwheel_t wheel, int *pow){
-	static P_INT factor, work = 0;
+void factor_init(factor_ctx_t *ctx, P_INT x, pwheel_t whl){
+	if(x <= 1){
+		ctx->whl = NULL;  // Nothing to factorize so start in complete mode
+		return;
+	}
 	
-	// Initialize static variables in complete mode
-	static pwheel_t whl = NULL;
-	// Use num to track prime or increment
-	static unsigned char *num = NULL;
-	static int do_wheel_primes = 1;
+	ctx->work = x;
+	ctx->whl = whl;
 	
-	// Reset values when new number is given
-	if(x && wheel){
-		if(x <= 1){
-			whl = NULL; // Ensure that function is set to complete mode
-			return x == 1;
-		}
-		
-		work = x;
-		whl = wheel;
-		
-		// Setup to check through primes
-		num = whl->first_prime;
-		// Indicate to function to check trial divide by the wheel primes
-		do_wheel_primes = 1;
-	}else if(!whl){
-		// Return 0 if prior task has completed
-		return 0;
-	}
+	// Setup to check through primes
+	ctx->num = whl->first_prime;
+	ctx->tdiv = NULL;
+	// Indicate to function to check trial divide by the wheel primes
+	ctx->do_wheel_primes = 1;
+}
+
+// Each call returns the next prime factor in ascending order along with its power
+// Returns 0 once the number has been completely factored
+P_INT factor_next(factor_ctx_t *ctx, int *pow){
+	// Return 0 if prior task has completed
+	pwheel_t whl = ctx->whl;
+	if(!whl) return 0;
 	
 	// Prevent Segfaults due to dereferencing NULL
 	int pow_sub;
 	if(!pow) pow = &pow_sub;
 	
 	// Iterate through base primes
-	if(do_wheel_primes){
-		// Use num to index through the primes
-		for(; num <= whl->last_prime && work >= *num; num++){
-			if(work == *num){
-				whl = NULL;  // Return to complete mode
+	if(ctx->do_wheel_primes){
+		// Use num to index through the primes and the table for all but 2
+		for(; ctx->num <= whl->last_prime && ctx->work >= *ctx->num; ctx->num++){
+			if(ctx->work == *ctx->num){
+				ctx->whl = NULL;  // Return to complete mode
 				*pow = 1;
-				return work;  // Return prime with power 1
-			}else if(work % *num == 0){
+				return ctx->work;  // Return prime with power 1
+			}else if(*ctx->num == 2){
+				// Remove all powers of 2 at once
+				if(!(ctx->work & 1)){
+					*pow = __builtin_ctzll(ctx->work);
+					ctx->work >>= *pow;
+					return *(ctx->num++);
+				}
+			}else{
 				// If work is divisible by num remove all powers
-				*pow = 0;
-				do{
-					work /= *num;
-					(*pow)++;
-				}while(work % *num == 0);
-				return *num;
+				const struct tdiv_s *t = TDIV_PRIMES + (ctx->num - whl->first_prime - 1);
+				if(tdiv_divides(ctx->work, t)){
+					*pow = tdiv_remove(&ctx->work, t);
+					return *(ctx->num++);
+				}
 			}
 		}
 		
-		do_wheel_primes = 0;
-		num = NULL;
-		nextnum_w(&num, &factor, whl); // Use num to index through increments
+		ctx->do_wheel_primes = 0;
+		ctx->tdiv = tdiv_after_w(whl);
 	}
 	
-	// Iterate through increments
-	while(factor * factor <= work){
-		if(work % factor == 0){
+	// Iterate through the primes of the trial division table
+	if(ctx->tdiv){
+		const struct tdiv_s *t = ctx->tdiv;
+		for(; t < TDIV_PRIMES + TDIV_LEN && (P_INT)t->p * t->p <= ctx->work; t++){
+			if(tdiv_divides(ctx->work, t)){
+				*pow = tdiv_remove(&ctx->work, t);
+				ctx->tdiv = t + 1;
+				return t->p;
+			}
+		}
+		
+		// Past the table carry on with the increments, otherwise factor^2 > work so they are skipped
+		ctx->tdiv = NULL;
+		if(t < TDIV_PRIMES + TDIV_LEN) ctx->factor = t->p;
+		else{
+			// Use num to index through increments
+			ctx->num = whl->tdiv_inc;
+			ctx->factor = whl->tdiv_num;
+		}
+	}
+	
+	// Iterate through increments, comparing with the quotient as factor^2 can overflow
+	P_INT factor = ctx->factor;
+	while(factor <= ctx->work / factor){
+		if(ctx->work % factor == 0){
 			// If work is divisible by current factor remove power of factor from work
 			*pow = 0;
 			do{
-				work /= factor;
+				ctx->work /= factor;
 				(*pow)++;
-			}while(work % factor == 0);
+			}while(ctx->work % factor == 0);
+			ctx->factor = factor;
 			return factor;
 		}
 		
-		nextnum_w(&num, &factor, whl);
+		nextnum_w(&ctx->num, &factor, whl);
 	}
 	
-	whl = NULL;  // Set whl to NULL to indicate number is completely factored
+	ctx->whl = NULL;  // Set whl to NULL to indicate number is completely factored
 	// Only return work if its prime
-	if(work > 1){
+	if(ctx->work > 1){
 		*pow = 1;
-		return work;
+		return ctx->work;
 	}else return 0;
 }
 
+int factor_all(P_INT x, pwheel_t whl, P_INT *primes, int *pows){
+	factor_ctx_t ctx;
+	factor_init(&ctx, x, whl);
+	
+	int len = 0;
+	for(P_INT fac = factor_next(&ctx, pows); fac; fac = factor_next(&ctx, pows + len)){
+		primes[len++] = fac;
+	}
+	return len;
+}
+
+// When called repeatedly it will return each prime factor
+// in ascending order along with its corresponding power.
+// Returns 0 if no number given to factor or the prior number has been completely factored
+P_INT factorize_w(P_INT x, pwheel_t wheel, int *pow){
+	// Context for the number currently being factorized
+	static factor_ctx_t ctx = {0, 0, NULL, NULL, NULL, 0};
+	
+	// Reset values when new number is given
+	if(x && wheel){
+		factor_init(&ctx, x, wheel);
+		if(x <= 1) return x == 1;
+	}
+	return factor_next(&ctx, pow);
+}
+
+
+
+// Greatest common divisor using the binary method
+static P_INT gcd(P_INT a, P_INT b){
+	if(a == 0) return b;
+	if(b == 0) return a;
+	int shift = __builtin_ctzll(a | b);
+	a >>= __builtin_ctzll(a);
+	while(b){
+		b >>= __builtin_ctzll(b);
+		if(a > b){ P_INT t = a; a = b; b = t; }
+		b -= a;
+	}
+	return a << shift;
+}
+
+// Number of steps between the gcds of Pollard-Brent rho
+#define RHO_GCD_STEPS 128
+// Number of steps after which a polynomial is given up on
+#define RHO_MAX_STEPS ((P_INT)1 << 20)
 
+/* Find a nontrivial factor of odd composite n using Brent's version of
+ * Pollard's rho with the polynomial y^2 + c. The differences are
+ * multiplied together so only one gcd is needed for many steps.
+ * Returns 0 if no factor was found within RHO_MAX_STEPS steps
+ */
+static P_INT pollard_brent(P_INT n, P_INT c){
+	mont_t m;
+	mont_init(&m, n);
+	c = mont_to(&m, c);
+	
+	#define RHO_F(y) mont_add(&m, mont_mul(&m, y, y), c)
+	P_INT x, y = mont_to(&m, 2), ys = y, q = m.one, g = 1, r, k, i;
+	for(r = 1; g == 1 && r <= RHO_MAX_STEPS; r <<= 1){
+		x = y;
+		for(i = 0; i < r; i++) y = RHO_F(y);
+		
+		for(k = 0; k < r && g == 1; k += RHO_GCD_STEPS){
+			ys = y;
+			for(i = 0; i < RHO_GCD_STEPS && i < r - k; i++){
+				y = RHO_F(y);
+				q = mont_mul(&m, q, x > y ? x - y : y - x);
+			}
+			// Montgomery form only multiplies by a unit so the gcd is unchanged
+			g = gcd(q, n);
+		}
+	}
+	
+	// Product skipped over the factor so step through from the last good ys
+	if(g == n){
+		do{
+			ys = RHO_F(ys);
+			g = gcd(x > ys ? x - ys : ys - x, n);
+		}while(g == 1);
+	}
+	#undef RHO_F
+	
+	return g == 1 || g == n ? 0 : g;
+}
 
-static P_INT mod_pow(P_INT x, P_INT pow, P_INT modulo){
-	// Create bit mask to obtain MSB
-	P_INT mask = (P_INT)1 << sizeof(pow) * 8 - 1;
+/* Find a nontrivial factor of odd composite n using Shanks' square forms
+ * factorization trying several multipliers of n
+ * Returns 0 if no factor was found
+ */
+static P_INT squfof(P_INT n){
+	static const P_INT MULTIPLIERS[] = {
+		1, 3, 5, 7, 11, 3 * 5, 3 * 7, 3 * 11, 5 * 7, 5 * 11, 7 * 11,
+		3 * 5 * 7, 3 * 5 * 11, 3 * 7 * 11, 5 * 7 * 11, 3 * 5 * 7 * 11
+	};
+	P_INT s = isqrt(n);
+	if(s * s == n) return s;
 	
-	P_INT work = 1;
-	for(; pow > 0; pow <<= 1){
-		// Check if top bit is set
-		// If yes then multiply by the base
-		if(pow & mask){
-			work *= x;
-			work %= modulo;
+	for(size_t k = 0; k < sizeof(MULTIPLIERS) / sizeof(P_INT) && n <= ~(P_INT)0 / MULTIPLIERS[k]; k++){
+		P_INT d = MULTIPLIERS[k] * n, p0 = isqrt(d), p = p0, p_prev = p0;
+		P_INT q_prev = 1, q = d - p0 * p0, b, t, r = 0;
+		if(q == 0) continue;
+		
+		// Forward cycle until reaching a square form Q = r^2
+		P_INT i, bound = 6 * isqrt(2 * s);
+		for(i = 2; i < bound; i++){
+			b = (p0 + p) / q;
+			p = b * q - p;
+			t = q;
+			// Unsigned arithmetic wraps around to the correct nonnegative value
+			q = q_prev + b * (p_prev - p);
+			r = isqrt(q);
+			if(!(i & 1) && r * r == q) break;
+			q_prev = t;
+			p_prev = p;
 		}
+		if(i >= bound) continue;
 		
-		work *= work;
-		work %= modulo;
+		// Reverse cycle from the square root of the form until P repeats
+		b = (p0 - p) / r;
+		p_prev = p = b * r + p;
+		q_prev = r;
+		q = (d - p_prev * p_prev) / q_prev;
+		do{
+			b = (p0 + p) / q;
+			p_prev = p;
+			p = b * q - p;
+			t = q;
+			q = q_prev + b * (p_prev - p);
+			q_prev = t;
+		}while(p != p_prev);
+		
+		r = gcd(n, q_prev);
+		if(r != 1 && r != n) return r;
+	}
+	return 0;
+}
+
+// Bound up to which factorize_rho uses trial division
+#define RHO_TRIAL_BOUND 1024
+
+int factorize_rho(P_INT x, P_INT *primes, int *pows){
+	// Every prime factor with multiplicity, at most 64 of them
+	P_INT found[64], stack[64];
+	int i, j, len = 0, top = 0;
+	if(x <= 1) return 0;
+	
+	// Quick trial division pass using the table of inverses
+	for(; !(x & 1); x >>= 1) found[len++] = 2;
+	const struct tdiv_s *t;
+	for(t = TDIV_PRIMES; t->p < RHO_TRIAL_BOUND && (P_INT)t->p * t->p <= x; t++){
+		for(; tdiv_divides(x, t); x *= t->inv) found[len++] = t->p;
+	}
+	P_INT d = t->p;
+	if(x > 1 && d * d > x){
+		// Remaining cofactor has no factor below its square root
+		found[len++] = x;
+		x = 1;
+	}
+	
+	// Split the composite parts until only primes remain
+	if(x > 1) stack[top++] = x;
+	while(top > 0){
+		x = stack[--top];
+		if(is_prime_mr64(x)){
+			found[len++] = x;
+			continue;
+		}
+		
+		// Try a few polynomials before resorting to SQUFOF
+		for(d = 0, i = 1; !d && i <= 8; i++) d = pollard_brent(x, i);
+		if(!d) d = squfof(x);
+		if(!d){
+			// Could not split x, report it as is rather than lose it
+			found[len++] = x;
+			continue;
+		}
+		stack[top++] = d;
+		stack[top++] = x / d;
+	}
+	
+	// Sort the factors and combine equal ones into powers
+	for(i = 1; i < len; i++){
+		P_INT f = found[i];
+		for(j = i; j > 0 && found[j - 1] > f; j--) found[j] = found[j - 1];
+		found[j] = f;
+	}
+	int cnt = 0;
+	for(i = 0; i < len; i++){
+		if(cnt > 0 && primes[cnt - 1] == found[i]) pows[cnt - 1]++;
+		else{
+			primes[cnt] = found[i];
+			pows[cnt++] = 1;
+		}
+	}
+	return cnt;
+}
+
+
+
+// Number of consecutive integers factorized at a time by factorize_range
+#define FACTOR_SEG ((P_INT)1 << 15)
+
+// Entry in the list of prime factors of a number in the segment
+struct factor_node_s{
+	uint32_t prime;
+	uint32_t next;  // Index of next entry or 0 at the end of the list
+	int pow;
+};
+
+void factorize_range(P_INT lower, P_INT upper, void (*emit)(P_INT x, const P_INT *primes, const int *pows, int len, void *arg), void *arg){
+	if(upper < lower) return;
+	P_INT size = upper - lower + 1;
+	
+	size_t k, len;
+	uint32_t *primes = sieving_primes(isqrt(upper), &len);
+	
+	// Offset from lower of the next multiple of each prime
+	P_INT *next = malloc(sizeof(P_INT) * (len + 1));
+	for(k = 0; k < len; k++){
+		P_INT p = primes[k];
+		next[k] = (p - lower % p) % p;
+	}
+	
+	// Unfactored part of each number and the head and tail of its factor list
+	P_INT *rem = malloc(sizeof(P_INT) * FACTOR_SEG);
+	uint32_t *head = malloc(sizeof(uint32_t) * FACTOR_SEG), *tail = malloc(sizeof(uint32_t) * FACTOR_SEG);
+	size_t pool_cap = 4 * FACTOR_SEG, pool_len;
+	struct factor_node_s *pool = malloc(sizeof(struct factor_node_s) * pool_cap);
+	
+	P_INT fac_primes[RHO_MAX_FACTORS];
+	int fac_pows[RHO_MAX_FACTORS];
+	
+	P_INT lo, hi, i;
+	for(lo = 0; lo < size; lo += FACTOR_SEG){
+		hi = size - lo > FACTOR_SEG ? lo + FACTOR_SEG : size;
+		for(i = lo; i < hi; i++){
+			rem[i - lo] = lower + i;
+			head[i - lo] = 0;
+		}
+		pool_len = 1;  // Entry 0 marks the end of a list
+		
+		// Primes are processed in ascending order so appending
+		// to the lists keeps the factors sorted
+		for(k = 0; k < len; k++){
+			P_INT p = primes[k];
+			for(i = next[k]; i < hi; i += p){
+				P_INT *r = rem + (i - lo);
+				if(*r == 0) continue;
+				
+				// Divide out p keeping the quotient so each step is a single division
+				int pow = 1;
+				P_INT v = *r / p, q;
+				for(; (q = v / p) * p == v; pow++) v = q;
+				*r = v;
+				
+				if(pool_len >= pool_cap) pool = realloc(pool, sizeof(struct factor_node_s) * (pool_cap <<= 1));
+				pool[pool_len] = (struct factor_node_s){p, 0, pow};
+				if(head[i - lo]) pool[tail[i - lo]].next = pool_len;
+				else head[i - lo] = pool_len;
+				tail[i - lo] = pool_len++;
+			}
+			next[k] = i;
+		}
+		
+		// Anything left over is a prime above sqrt(upper)
+		for(i = lo; i < hi; i++){
+			int cnt = 0;
+			for(uint32_t e = head[i - lo]; e; e = pool[e].next){
+				fac_primes[cnt] = pool[e].prime;
+				fac_pows[cnt++] = pool[e].pow;
+			}
+			if(rem[i - lo] > 1){
+				fac_primes[cnt] = rem[i - lo];
+				fac_pows[cnt++] = 1;
+			}
+			emit(lower + i, fac_primes, fac_pows, lower + i == 0 ? 0 : cnt, arg);
+		}
 	}
-	return work;
+	
+	free(pool);
+	free(tail);
+	free(head);
+	free(rem);
+	free(next);
+	free(primes);
+}
+
+
+
+/* Strong probable prime test of odd x = m->n to base a
+ * where x - 1 == odd_base * 2^two_pow
+ * Returns 1 if x is a strong probable prime to base a
+ */
+static int strong_prp(const mont_t *m, P_INT a, P_INT odd_base, unsigned short two_pow){
+	// if witness == 0 (mod tested) then test will be erroneous
+	if(a % m->n == 0) return 1;
+	P_INT minus_one = m->n - m->one;  // Montgomery form of x - 1
+	
+	// Calculate: witpow <- wit ^ odd_base (mod x)
+	P_INT witpow = mont_pow(m, mont_to(m, a), odd_base);
+	
+	// Check if: witpow == 1 (mod x)
+	if(witpow == m->one || witpow == minus_one) return 1;
+	
+	// Check if: there exists natural number n s.t.  witpow ^ (2 ^ n) == -1 (mod x)
+	for(; two_pow > 1; two_pow--){
+		witpow = mont_mul(m, witpow, witpow);
+		if(witpow == minus_one) return 1;
+	}
+	
+	// If no n exists x is composite
+	return 0;
 }
 
 int is_prime_mr(P_INT x, size_t wits_len, P_INT *wits){
 	if(x < 2){ // 0 and 1 can cause errors
 		return 0;
 	}
+	// Montgomery form needs an odd modulus
+	if(x % 2 == 0) return x == 2;
 	
 	// x - 1 == odd_base * 2 ^ two_pow
 	P_INT odd_base = x - 1;
-	unsigned short two_pow = 0;
-	while(odd_base % 2 == 0){
-		odd_base /= 2;
-		two_pow++;
-	}
+	unsigned short two_pow = __builtin_ctzll(odd_base);
+	odd_base >>= two_pow;
 	
-	P_INT witpow;
-	unsigned short pow_cnt;
+	mont_t m;
+	mont_init(&m, x);
 	for(; wits_len > 0; wits_len--, wits++){
-		if(*wits % x == 0) continue; // if witness == 0 (mod tested) then test will be erroneous
-		
-		// Calculate: witpow <- wit ^ odd_base (mod x) 
-		witpow = *wits;
-		witpow = mod_pow(witpow, odd_base, x);
+		if(!strong_prp(&m, *wits, odd_base, two_pow)) return 0;
+	}
+	
+	return 1;
+}
+
+// Witnesses that together make Miller Rabin deterministic for every x < 2^64
+static const P_INT MR64_WITS[] = {2, 325, 9375, 28178, 450775, 9780504, 1795265022};
+
+int is_prime_mr64(P_INT x){
+	// Trial divide by small primes so the witnesses are never multiples of x
+	static const unsigned char SMALL_PRIMES[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+	for(size_t i = 0; i < sizeof(SMALL_PRIMES); i++){
+		if(x == SMALL_PRIMES[i]) return 1;
+		if(x % SMALL_PRIMES[i] == 0) return 0;
+	}
+	if(x < 41 * 41) return x > 1;
+	
+	return is_prime_mr(x, sizeof(MR64_WITS) / sizeof(P_INT), (P_INT *)MR64_WITS);
+}
+
+
+
+// Primes below this bound are trial divided before the probable prime tests of is_prime_bpsw
+#define BPSW_TRIAL_BOUND 100
+
+/* Jacobi symbol (a / n) of a in [0, n) for odd n
+ * Returns -1, 0 or 1
+ */
+static int jacobi(P_INT a, P_INT n){
+	int j = 1;
+	while(a){
+		// (2 / n) == -1 exactly when n == 3 or 5 (mod 8)
+		int twos = __builtin_ctzll(a);
+		a >>= twos;
+		if((twos & 1) && ((n & 7) == 3 || (n & 7) == 5)) j = -j;
 		
-		// Check if: witpow == 1 (mod x)
-		if(witpow == 1 || witpow == x - 1) continue;
+		// Quadratic reciprocity flips the sign when both are 3 (mod 4)
+		if((a & 3) == 3 && (n & 3) == 3) j = -j;
+		P_INT t = n % a;
+		n = a;
+		a = t;
+	}
+	return n == 1 ? j : 0;
+}
+
+// Half of a (mod n) for odd n without overflowing
+static inline P_INT mont_half(const mont_t *m, P_INT a){
+	return (a >> 1) + (a & 1 ? (m->n >> 1) + 1 : 0);
+}
+
+/* Strong Lucas probable prime test of odd x = m->n with P = 1
+ * and Q = (1 - d) / 4 where d is the Selfridge parameter
+ * with Jacobi symbol (d / x) == -1, given in Montgomery form
+ * Returns 1 if x is a strong Lucas probable prime
+ */
+static int strong_lucas_prp(const mont_t *m, P_INT d, P_INT q){
+	// x + 1 == odd_base * 2^two_pow, x + 1 can't overflow as 2^64 - 1 is divisible by 3
+	P_INT odd_base = m->n + 1;
+	int two_pow = __builtin_ctzll(odd_base);
+	odd_base >>= two_pow;
+	
+	// Walk the bits of odd_base from the top with U_k, V_k and Q^k
+	P_INT u = m->one, v = m->one, qk = q;
+	for(int bit = 62 - __builtin_clzll(odd_base); bit >= 0; bit--){
+		// U_2k = U_k V_k, V_2k = V_k^2 - 2 Q^k
+		u = mont_mul(m, u, v);
+		v = mont_sub(m, mont_mul(m, v, v), mont_add(m, qk, qk));
+		qk = mont_mul(m, qk, qk);
+		if(odd_base >> bit & 1){
+			// U_k+1 = (U_k + V_k) / 2, V_k+1 = (d U_k + V_k) / 2
+			P_INT du = mont_mul(m, d, u);
+			u = mont_half(m, mont_add(m, u, v));
+			v = mont_half(m, mont_add(m, du, v));
+			qk = mont_mul(m, qk, q);
+		}
+	}
+	
+	// Check if: U_odd_base == 0 or V_(odd_base * 2^r) == 0 (mod x) for some r < two_pow
+	if(u == 0 || v == 0) return 1;
+	for(; two_pow > 1; two_pow--){
+		v = mont_sub(m, mont_mul(m, v, v), mont_add(m, qk, qk));
+		qk = mont_mul(m, qk, qk);
+		if(v == 0) return 1;
+	}
+	return 0;
+}
+
+int is_prime_bpsw(P_INT x){
+	if(x <= 1) return 0;
+	if(!(x & 1)) return x == 2;
+	
+	// Trial divide by the small odd primes of the table
+	for(const struct tdiv_s *t = TDIV_PRIMES; t->p < BPSW_TRIAL_BOUND; t++){
+		if((P_INT)t->p * t->p > x) return 1;
+		if(tdiv_divides(x, t)) return x == t->p;
+	}
+	
+	// x - 1 == odd_base * 2 ^ two_pow
+	P_INT odd_base = x - 1;
+	unsigned short two_pow = __builtin_ctzll(odd_base);
+	odd_base >>= two_pow;
+	
+	mont_t m;
+	mont_init(&m, x);
+	if(!strong_prp(&m, 2, odd_base, two_pow)) return 0;
+	
+	// No Selfridge parameter exists for squares
+	P_INT r = isqrt(x);
+	if(r * r == x) return 0;
+	
+	// Selfridge's choice of d as the first of 5, -7, 9, -11, ... with (d / x) == -1
+	P_INT d = 5;
+	int neg = 0, j;
+	for(; (j = jacobi(neg ? x - d % x : d % x, x)) != -1; d += 2, neg = !neg){
+		// d shares a factor with x which is larger than d
+		if(j == 0) return 0;
+	}
+	
+	// Montgomery forms of d and Q = (1 - d) / 4
+	P_INT md = mont_to(&m, d), mq = mont_to(&m, neg ? (d + 1) / 4 : (d - 1) / 4);
+	if(neg) md = mont_sub(&m, 0, md);
+	else mq = mont_sub(&m, 0, mq);
+	
+	return strong_lucas_prp(&m, md, mq);
+}
+
+
+
+// Number of candidates tested in lockstep by is_prime_mr_batch
+#define MR_LANES 8
+
+// Witnesses that make Miller Rabin deterministic for x < 4759123141
+static const P_INT MR32_WITS[] = {2, 7, 61};
+
+// Primes below this are trial divided before the batched test
+#define MR_TRIAL_BOUND 41
+
+// Settle x with trial division by the primes below MR_TRIAL_BOUND
+// Returns 1 if prime, 0 if composite, or -1 if x needs a full test
+static int mr_trial(P_INT x){
+	if(x <= 1) return 0;
+	if(!(x & 1)) return x == 2;
+	
+	// Trial divide by the small odd primes of the table
+	for(const struct tdiv_s *t = TDIV_PRIMES; t->p < MR_TRIAL_BOUND; t++){
+		if((P_INT)t->p * t->p > x) return 1;
+		if(tdiv_divides(x, t)) return x == t->p;
+	}
+	return x < MR_TRIAL_BOUND * MR_TRIAL_BOUND ? 1 : -1;
+}
+
+/* Test MR_LANES odd numbers of any size in lockstep with 64-bit Montgomery
+ * Each step is done for every lane before moving on so the independent
+ * 128-bit multiplies of the lanes overlap in the pipeline
+ */
+static void mr_lanes64(const P_INT *xs, const P_INT *wits, size_t wits_len, unsigned char *out){
+	mont_t m[MR_LANES];
+	P_INT odd_base[MR_LANES], work[MR_LANES], base[MR_LANES], minus_one;
+	int l, two_pow[MR_LANES], max_bits = 0, max_two_pow = 0;
+	for(l = 0; l < MR_LANES; l++){
+		mont_init(m + l, xs[l]);
+		two_pow[l] = __builtin_ctzll(xs[l] - 1);
+		odd_base[l] = (xs[l] - 1) >> two_pow[l];
+		if(64 - __builtin_clzll(odd_base[l]) > max_bits) max_bits = 64 - __builtin_clzll(odd_base[l]);
+		if(two_pow[l] > max_two_pow) max_two_pow = two_pow[l];
+		out[l] = 1;
+	}
+	
+	for(size_t w = 0; w < wits_len; w++){
+		// Left to right exponentiation, lanes with shorter exponents just square one
+		for(l = 0; l < MR_LANES; l++){
+			work[l] = m[l].one;
+			base[l] = mont_to(m + l, wits[w]);
+		}
+		for(int bit = max_bits - 1; bit >= 0; bit--){
+			for(l = 0; l < MR_LANES; l++){
+				work[l] = mont_mul(m + l, work[l], work[l]);
+				if(odd_base[l] >> bit & 1) work[l] = mont_mul(m + l, work[l], base[l]);
+			}
+		}
 		
-		// Check if: there exists natural number n s.t.  witpow ^ (2 ^ n) == -1 (mod x)
-		int probable_prime = 0;
-		for(pow_cnt = two_pow; pow_cnt > 0; pow_cnt--){
-			witpow *= witpow;
-			witpow %= x;
-			
-			if(witpow == x - 1){
-				probable_prime = 1;
-				break;
+		// Lane passes if work == +-1 or squares to -1 within two_pow - 1 steps
+		unsigned char pass[MR_LANES];
+		for(l = 0; l < MR_LANES; l++){
+			minus_one = m[l].n - m[l].one;
+			pass[l] = wits[w] % m[l].n == 0 || work[l] == m[l].one || work[l] == minus_one;
+		}
+		for(int r = 1; r < max_two_pow; r++){
+			for(l = 0; l < MR_LANES; l++){
+				work[l] = mont_mul(m + l, work[l], work[l]);
+				pass[l] |= r < two_pow[l] && work[l] == m[l].n - m[l].one;
 			}
 		}
+		for(l = 0; l < MR_LANES; l++) out[l] &= pass[l];
+	}
+}
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+
+// Vector operations on 64-bit lanes used by the 32-bit Montgomery kernel
+#ifdef __AVX512F__
+	#define VLANES 8
+	typedef __m512i vec_t;
+	typedef __mmask8 vmask_t;
+	#define v_load(p) _mm512_loadu_si512((const void *)(p))
+	#define v_store(p, a) _mm512_storeu_si512((void *)(p), a)
+	#define v_set1(x) _mm512_set1_epi64((long long)(x))
+	#define v_mul32(a, b) _mm512_mul_epu32(a, b)
+	#define v_add(a, b) _mm512_add_epi64(a, b)
+	#define v_sub(a, b) _mm512_sub_epi64(a, b)
+	#define v_and(a, b) _mm512_and_si512(a, b)
+	#define v_srli(a, c) _mm512_srli_epi64(a, c)
+	#define v_gt(a, b) _mm512_cmpgt_epi64_mask(a, b)
+	#define v_eq(a, b) _mm512_cmpeq_epi64_mask(a, b)
+	#define v_neg(a) _mm512_cmplt_epi64_mask(a, _mm512_setzero_si512())
+	#define v_select(m, a, b) _mm512_mask_blend_epi64(m, b, a)
+	#define m_or(m, n) ((vmask_t)((m) | (n)))
+	#define m_and(m, n) ((vmask_t)((m) & (n)))
+	#define m_bits(m) ((unsigned int)(m))
+#else
+	#define VLANES 4
+	typedef __m256i vec_t;
+	typedef __m256i vmask_t;
+	#define v_load(p) _mm256_loadu_si256((const __m256i *)(p))
+	#define v_store(p, a) _mm256_storeu_si256((__m256i *)(p), a)
+	#define v_set1(x) _mm256_set1_epi64x((long long)(x))
+	#define v_mul32(a, b) _mm256_mul_epu32(a, b)
+	#define v_add(a, b) _mm256_add_epi64(a, b)
+	#define v_sub(a, b) _mm256_sub_epi64(a, b)
+	#define v_and(a, b) _mm256_and_si256(a, b)
+	#define v_srli(a, c) _mm256_srli_epi64(a, c)
+	#define v_gt(a, b) _mm256_cmpgt_epi64(a, b)
+	#define v_eq(a, b) _mm256_cmpeq_epi64(a, b)
+	#define v_neg(a) _mm256_cmpgt_epi64(_mm256_setzero_si256(), a)
+	#define v_select(m, a, b) _mm256_blendv_epi8(b, a, m)
+	#define m_or(m, n) _mm256_or_si256(m, n)
+	#define m_and(m, n) _mm256_and_si256(m, n)
+	#define m_bits(m) ((unsigned int)_mm256_movemask_pd(_mm256_castsi256_pd(m)))
+#endif
+
+/* Montgomery product modulo n < 2^32 in every lane with R = 2^32
+ * a and b hold numbers below n in the low halves of their lanes
+ * and inv holds n^-1 (mod 2^32)
+ */
+static inline vec_t v_mont_mul(vec_t a, vec_t b, vec_t n, vec_t inv){
+	vec_t t = v_mul32(a, b);
+	vec_t q = v_mul32(t, inv);  // Only the low 32 bits of q are used
+	vec_t r = v_sub(v_srli(t, 32), v_srli(v_mul32(q, n), 32));
+	return v_select(v_neg(r), v_add(r, n), r);
+}
+
+/* Test VLANES odd numbers below 2^32 in lockstep with vector instructions
+ * using 32-bit Montgomery multiplication in each 64-bit lane
+ */
+static void mr_lanes32(const P_INT *xs, const P_INT *wits, size_t wits_len, unsigned char *out){
+	uint64_t inv[VLANES], one[VLANES], r2[VLANES], odd_base[VLANES], two_pow[VLANES];
+	int l, max_bits = 0, max_two_pow = 0;
+	for(l = 0; l < VLANES; l++){
+		uint32_t x = (uint32_t)xs[l], iv = x;
+		for(int i = 0; i < 4; i++) iv *= 2 - x * iv;
+		inv[l] = iv;
+		one[l] = ((uint64_t)1 << 32) % x;
+		r2[l] = one[l] * one[l] % x;
+		two_pow[l] = __builtin_ctzll(xs[l] - 1);
+		odd_base[l] = (xs[l] - 1) >> two_pow[l];
+		if(64 - __builtin_clzll(odd_base[l]) > max_bits) max_bits = 64 - __builtin_clzll(odd_base[l]);
+		if((int)two_pow[l] > max_two_pow) max_two_pow = two_pow[l];
+	}
+	
+	vec_t n = v_load(xs), vinv = v_load(inv), vone = v_load(one), vr2 = v_load(r2);
+	vec_t vexp = v_load(odd_base), vtwo_pow = v_load(two_pow), minus_one = v_sub(n, vone);
+	vec_t bit1 = v_set1(1);
+	unsigned int prime_bits = (1u << VLANES) - 1;
+	
+	for(size_t w = 0; w < wits_len; w++){
+		// Witnesses are below 41^2 < x so they are already reduced
+		vec_t base = v_mont_mul(v_set1(wits[w]), vr2, n, vinv), work = vone;
+		for(int bit = max_bits - 1; bit >= 0; bit--){
+			work = v_mont_mul(work, work, n, vinv);
+			vmask_t set = v_eq(v_and(v_srli(vexp, bit), bit1), bit1);
+			work = v_select(set, v_mont_mul(work, base, n, vinv), work);
+		}
 		
-		// If no n exists x is composite
-		if(!probable_prime) return 0;
+		vmask_t pass = m_or(v_eq(work, vone), v_eq(work, minus_one));
+		for(int r = 1; r < max_two_pow; r++){
+			work = v_mont_mul(work, work, n, vinv);
+			// Only count squarings r < two_pow of each lane
+			vmask_t in_range = v_gt(vtwo_pow, v_set1(r));
+			pass = m_or(pass, m_and(in_range, v_eq(work, minus_one)));
+		}
+		prime_bits &= m_bits(pass);
 	}
 	
-	return 1;
+	for(l = 0; l < VLANES; l++) out[l] = prime_bits >> l & 1;
+}
+#endif
+
+/* Test the numbers xs[idx[k]] for k < len MR_LANES at a time storing results into out
+ * Only the first witness is used if rest is 0, otherwise all of the remaining witnesses
+ */
+static void mr_lanes(const P_INT *xs, const size_t *idx, size_t len, int rest, uint8_t *out){
+	size_t len32 = sizeof(MR32_WITS) / sizeof(P_INT), len64 = sizeof(MR64_WITS) / sizeof(P_INT);
+	const P_INT *wits32 = MR32_WITS + rest, *wits64 = MR64_WITS + rest;
+	len32 = rest ? len32 - 1 : 1;
+	len64 = rest ? len64 - 1 : 1;
+	
+	P_INT lanes[MR_LANES];
+	unsigned char res[MR_LANES];
+	int l;
+	
+	for(size_t k = 0; k < len; k += MR_LANES){
+		// Pad a partial batch by repeating the first lane
+		int full = len - k < MR_LANES ? len - k : MR_LANES;
+		for(l = 0; l < MR_LANES; l++) lanes[l] = xs[idx[k + (l < full ? l : 0)]];
+		
+		int fits = 1;
+		for(l = 0; l < MR_LANES; l++) fits &= lanes[l] < ((P_INT)1 << 32);
+		#if defined(__AVX512F__) || defined(__AVX2__)
+		if(fits){
+			for(l = 0; l < MR_LANES; l += VLANES) mr_lanes32(lanes + l, wits32, len32, res + l);
+		}else
+		#endif
+		if(fits) mr_lanes64(lanes, wits32, len32, res);
+		else mr_lanes64(lanes, wits64, len64, res);
+		
+		for(l = 0; l < full; l++) out[idx[k + l]] = res[l];
+	}
+}
+
+void is_prime_mr_batch(const P_INT *xs, size_t n, uint8_t *out){
+	// Settle small numbers and queue the others to be tested
+	size_t i, k, len = 0;
+	size_t *idx = malloc(sizeof(size_t) * (n + 1));
+	for(i = 0; i < n; i++){
+		int r = mr_trial(xs[i]);
+		if(r >= 0) out[i] = r;
+		else idx[len++] = i;
+	}
+	if(len == 0){
+		free(idx);
+		return;
+	}
+	
+	// Most composites fail the first witness, 2 in both witness sets, so
+	// test it alone first and only run the rest on the numbers that pass
+	mr_lanes(xs, idx, len, 0, out);
+	for(i = k = 0; i < len; i++) if(out[idx[i]]) idx[k++] = idx[i];
+	
+	// Remaining witnesses for the strong probable primes to base 2
+	mr_lanes(xs, idx, k, 1, out);
+	free(idx);
 }
 
 
@@ -355,3 +1807,48 @@ int is_prime_fmt(P_INT x, pwheel_t whl, float above_sqrt){
 }
 
 
+
+void prime_reader_init(prime_reader_t *r, const void *buf, size_t len, int format){
+	r->pos = buf;
+	r->end = r->pos + len;
+	r->last = 0;
+	r->format = format;
+}
+
+int prime_reader_next(prime_reader_t *r, P_INT *p){
+	if(r->pos >= r->end) return 0;
+	
+	if(r->format == PRIME_FMT_U64LE){
+		if(r->end - r->pos < 8) return -1;
+		P_INT x = 0;
+		for(int k = 7; k >= 0; k--) x = x << 8 | r->pos[k];
+		r->pos += 8;
+		return *p = r->last = x, 1;
+	}
+	
+	// Gaps are stored 7 bits at a time starting from the lowest with the high bit set on all but the last byte
+	P_INT gap = 0;
+	for(unsigned int shift = 0; shift < 64; shift += 7){
+		unsigned char byte = *r->pos++;
+		gap |= (P_INT)(byte & 0x7f) << shift;
+		if(!(byte & 0x80)){
+			*p = r->last += gap;
+			return 1;
+		}
+		if(r->pos >= r->end) return -1;
+	}
+	return -1;
+}
+
+size_t prime_reader_read(prime_reader_t *r, P_INT *primes, size_t max){
+	size_t len = 0;
+	while(len < max){
+		// Most gaps fit in a single byte so take those without the general loop
+		if(r->format == PRIME_FMT_DELTA_VARINT && r->pos < r->end && !(*r->pos & 0x80)){
+			primes[len++] = r->last += *r->pos++;
+		}else if(prime_reader_next(r, primes + len) > 0){
+			len++;
+		}else break;
+	}
+	return len;
+}
@@ -12,8 +12,280 @@ P_INT prime_sieve(unsigned char *primality, P_INT size);
 // Storing result into the bit array primality
 P_INT prime_sieve_bs(bits_t primality, P_INT size);
 
+/* Use a segmented Sieve of Eratosthenes to check primality of
+ * all numbers in the range [lower, upper]. Only the primes up to
+ * sqrt(upper) are generated and the range is sieved in cache sized
+ * windows so memory use is proportional to upper - lower.
+ * 
+ * Usage:
+ *   P_INT lower = 1000000000000, upper = lower + 1000000;
+ *   bits_t bs = malloc(byte_size(upper - lower + 1));
+ *   prime_sieve_seg(bs, lower, upper);
+ *   getbit(bs, 39);  // 1000000000039 is prime => Returns 1
+ * 
+ * Arguments:
+ *   bits_t primality : bit array of at least upper - lower + 1 bits
+ *     where bit i will store the primality of lower + i
+ *   P_INT lower : smallest number to check
+ *   P_INT upper : largest number to check
+ * 
+ * Returns:
+ *   P_INT : number of primes in [lower, upper]
+ */
+P_INT prime_sieve_seg(bits_t primality, P_INT lower, P_INT upper);
+
+/* Segmented Sieve of Eratosthenes on [lower, upper] storing the
+ * result in a wheel compressed bit array which holds only the
+ * numbers coprime to 30. This takes a byte for every 30 numbers
+ * and skips crossing off the multiples of 2, 3, and 5.
+ * 
+ * Usage:
+ *   P_INT lower = 1000, upper = 2000, base = lower - lower % 30;
+ *   unsigned char *bs = malloc(w30_size(upper - base + 1));
+ *   prime_sieve_w30(bs, lower, upper);  // Returns 135
+ *   getbit30(bs, 1009 - base);  // 1009 is prime => Returns 1
+ * 
+ * Arguments:
+ *   unsigned char *primality : wheel bit array with room for
+ *     w30_size(upper - base + 1) bytes where base = lower - lower % 30
+ *     and the bit for lower + i is at index lower + i - base
+ *     NOTE: The primes 2, 3, and 5 have no bit and bits for
+ *       numbers outside of [lower, upper] are cleared
+ *   P_INT lower : smallest number to check
+ *   P_INT upper : largest number to check
+ * 
+ * Returns:
+ *   P_INT : number of primes in [lower, upper] including 2, 3, and 5
+ */
+P_INT prime_sieve_w30(unsigned char *primality, P_INT lower, P_INT upper);
+
+/* Same as prime_sieve_w30 except the bit array is split into chunks
+ * that are sieved independently by up to threads threads
+ * 
+ * Arguments:
+ *   unsigned char *primality : wheel bit array as for prime_sieve_w30
+ *   P_INT lower : smallest number to check
+ *   P_INT upper : largest number to check
+ *   unsigned int threads : maximum number of threads to sieve with
+ * 
+ * Returns:
+ *   P_INT : number of primes in [lower, upper] including 2, 3, and 5
+ */
+P_INT prime_sieve_w30_mt(unsigned char *primality, P_INT lower, P_INT upper, unsigned int threads);
+
+// Largest number of primes in a pattern searched for by w30_tuples
+#define W30_TUPLE_MAX 16
+
+// Pattern of a prime k-tuple as the offsets of its members from the first, setup by w30_tuple_init
+typedef struct w30_tuple_s{
+	size_t len;
+	P_INT offs[W30_TUPLE_MAX];  // Ascending offsets starting from 0
+	unsigned char bits;  // Bits of the residues r for which every r + offset is coprime to 30
+	// Bytes ahead and bit of p + offs[j] for p with the residue of bit b
+	P_INT ahead[8][W30_TUPLE_MAX];
+	unsigned char bit[8][W30_TUPLE_MAX];
+} w30_tuple_t;
+
+/* Setup the pattern of a prime k-tuple such as {0, 2} for the twin
+ * primes or {0, 2, 6} for one form of the prime triplets
+ * 
+ * Arguments:
+ *   w30_tuple_t *t : pattern to setup
+ *   const P_INT *offs : ascending offsets of the members from the first starting with 0
+ *   size_t len : number of offsets from 1 to W30_TUPLE_MAX
+ * 
+ * Returns:
+ *   int : 0 on success or -1 if the offsets aren't valid
+ */
+int w30_tuple_init(w30_tuple_t *t, const P_INT *offs, size_t len);
+
+/* Find every p in [from, to] for which p + offs[j] is prime for every
+ * offset of the pattern by combining whole words of a wheel bit array.
+ * Each member must be in the bit array, which is zero past upper.
+ * For the twin primes this is w & (w >> 1) masked to the pairs.
+ * 
+ * Usage:
+ *   P_INT twins[] = {0, 2};
+ *   w30_tuple_t t;
+ *   w30_tuple_init(&t, twins, 2);
+ *   unsigned char *bs = malloc(w30_size(1000 + 1));
+ *   prime_sieve_w30(bs, 1, 1000);
+ *   w30_tuples(bs, 0, 1000, 1, 1000, &t, NULL, NULL);  // Returns 35
+ * 
+ * Arguments:
+ *   const unsigned char *primality : wheel bit array from prime_sieve_w30
+ *   P_INT base : number of the first bit, a multiple of 30
+ *   P_INT upper : largest number in the bit array
+ *   P_INT from : smallest first member to look for, at least the lower bound sieved
+ *   P_INT to : largest first member to look for
+ *   const w30_tuple_t *t : pattern to look for
+ *   void (*found)(P_INT p, void *arg) : called with the first member of each
+ *     match in ascending order or NULL to only count them
+ *   void *arg : passed to every call of found
+ * 
+ * Returns:
+ *   P_INT : number of matches
+ */
+P_INT w30_tuples(const unsigned char *primality, P_INT base, P_INT upper, P_INT from, P_INT to, const w30_tuple_t *t, void (*found)(P_INT p, void *arg), void *arg);
+
+/* Walk the consecutive primes p < q of [from, to] in a wheel bit array
+ * and report each gap q - p larger than min_gap and every gap before it
+ * 
+ * Usage:
+ *   unsigned char *bs = malloc(w30_size(1000 + 1));
+ *   prime_sieve_w30(bs, 1, 1000);
+ *   P_INT first, last;
+ *   w30_gaps(bs, 0, 1, 1000, 0, &first, &last, NULL, NULL);  // Returns 20 from 887 to 907
+ * 
+ * Arguments:
+ *   const unsigned char *primality : wheel bit array from prime_sieve_w30
+ *   P_INT base : number of the first bit, a multiple of 30
+ *   P_INT from : smallest number to include
+ *   P_INT to : largest number to include
+ *   P_INT min_gap : gaps up to this are not reported
+ *   P_INT *first, *last : location to store the smallest and largest primes found, 0 if none
+ *   void (*record)(P_INT p, P_INT q, void *arg) : called for each reported gap
+ *     in ascending order or NULL
+ *   void *arg : passed to every call of record
+ * 
+ * Returns:
+ *   P_INT : largest gap found or min_gap if none are larger
+ */
+P_INT w30_gaps(const unsigned char *primality, P_INT base, P_INT from, P_INT to, P_INT min_gap, P_INT *first, P_INT *last, void (*record)(P_INT p, P_INT q, void *arg), void *arg);
+
+// Largest modulus for which aggregates keep a histogram of residues
+#define AGG_HIST_MAX 65536
+// Modulus and base of the polynomial hash of a sequence of primes
+#define AGG_HASH_MOD (((P_INT)1 << 61) - 1)
+#define AGG_HASH_BASE 0x1f3d5b79a2c4e687ULL
+
+// Reductions of an ascending sequence of primes which can be joined with the reductions of the sequence after it
+typedef struct prime_agg_s{
+	P_INT count;
+	P_INT first, last;  // Smallest and largest primes, 0 if none
+	unsigned __int128 sum;
+	P_INT mod;  // Modulus of the sum of squares and the histogram
+	P_INT sum_sq;  // Sum of p^2 (mod mod)
+	P_INT *hist;  // Number of primes p with each p (mod mod) or NULL if mod > AGG_HIST_MAX
+	P_INT hash;  // Sum of p * AGG_HASH_BASE^(primes after p) (mod AGG_HASH_MOD)
+	P_INT hash_pow;  // AGG_HASH_BASE^count (mod AGG_HASH_MOD)
+} prime_agg_t;
+
+/* Setup empty reductions of primes
+ * 
+ * Usage:
+ *   prime_agg_t a, b;
+ *   prime_agg_init(&a, 10);
+ *   prime_agg_init(&b, 10);
+ *   prime_agg_add(&a, 2);
+ *   prime_agg_add(&b, 3);
+ *   prime_agg_join(&a, &b);  // a.sum is 5 and a.sum_sq is 3
+ *   prime_agg_free(&a);
+ *   prime_agg_free(&b);
+ * 
+ * Arguments:
+ *   prime_agg_t *agg : reductions to setup
+ *   P_INT mod : modulus from 1 for the sum of squares and the histogram
+ */
+void prime_agg_init(prime_agg_t *agg, P_INT mod);
+
+// Empty the reductions keeping the modulus
+void prime_agg_clear(prime_agg_t *agg);
+
+// Add prime p which is larger than every prime added before
+void prime_agg_add(prime_agg_t *agg, P_INT p);
+
+// Add the reductions of next, whose primes are all larger, to agg
+void prime_agg_join(prime_agg_t *agg, const prime_agg_t *next);
+
+// Release the histogram of the reductions
+void prime_agg_free(prime_agg_t *agg);
+
+/* Add every prime of [from, to] in a wheel bit array to agg in ascending order
+ * 
+ * Arguments:
+ *   const unsigned char *primality : wheel bit array from prime_sieve_w30
+ *   P_INT base : number of the first bit, a multiple of 30
+ *   P_INT from : smallest number to include, at least the lower bound sieved
+ *   P_INT to : largest number to include
+ *   prime_agg_t *agg : reductions to add the primes to
+ */
+void w30_aggregate(const unsigned char *primality, P_INT base, P_INT from, P_INT to, prime_agg_t *agg);
+
+/* Count the primes less than or equal to x without sieving up to x.
+ * Uses Lucy_Hedgehog's combinatorial method which takes
+ * O(x^(3/4) / log(x)) time and O(sqrt(x)) memory.
+ * 
+ * Usage:
+ *   prime_count(100);  // Returns 25
+ *   prime_count(10000000000000);  // Returns 346065536839
+ * 
+ * Arguments:
+ *   P_INT x : upper bound on primes to count
+ * 
+ * Returns:
+ *   P_INT : number of primes p with p <= x
+ *           or 0 for x >= 3 if memory for the counts couldn't be allocated
+ */
+P_INT prime_count(P_INT x);
+
+
+// Position in the sequence of primes along with a window of them sieved around it
+typedef struct prime_iter_s{
+	P_INT *primes;  // Primes of the current window in ascending order
+	size_t len;  // Number of primes in the window
+	size_t pos;  // Index of the smallest prime at or after the position
+	P_INT win;  // Index of the current window
+	unsigned char *bs;  // Wheel bit array of the current window
+	uint32_t *sieving;  // Primes used to sieve each window
+	size_t sieving_len;
+	P_INT sieving_limit;  // Largest number sieving holds all of the primes up to
+} prime_iter_t;
+
+/* Setup an iterator over the primes starting from start
+ * Primes are found by sieving a small window of numbers at a time,
+ * the next window is only sieved once the current one is used up.
+ * Free with prime_iter_free.
+ * 
+ * Usage:
+ *   prime_iter_t it;
+ *   prime_iter_init(&it, 100);
+ *   prime_iter_next(&it);  // Returns 101
+ *   prime_iter_next(&it);  // Returns 103
+ *   prime_iter_prev(&it);  // Returns 103
+ *   prime_iter_prev(&it);  // Returns 101
+ *   prime_iter_prev(&it);  // Returns 97
+ *   prime_iter_free(&it);
+ * 
+ * Arguments:
+ *   prime_iter_t *it : iterator to setup
+ *   P_INT start : position to start from
+ */
+void prime_iter_init(prime_iter_t *it, P_INT start);
+
+/* Move forward to the smallest prime at or after the position
+ * The position is left just after the prime
+ * 
+ * Returns:
+ *   P_INT : next prime or 0 after the largest 64-bit prime
+ */
+P_INT prime_iter_next(prime_iter_t *it);
+
+/* Move back to the largest prime before the position
+ * The position is left at the prime
+ * 
+ * Returns:
+ *   P_INT : previous prime or 0 before 2
+ */
+P_INT prime_iter_prev(prime_iter_t *it);
+
+// Release the memory held by an iterator
+void prime_iter_free(prime_iter_t *it);
+
 typedef struct pwheel_s *pwheel_t;
 extern pwheel_t PWHEEL_6, PWHEEL_30;
+// Larger wheels whose tables are generated at build time
+extern pwheel_t PWHEEL_210, PWHEEL_2310, PWHEEL_30030;
 
 pwheel_t make_pwheel(unsigned char max);
 void free_pwheel(pwheel_t whl);
@@ -71,7 +343,7 @@ void nextnum_w(unsigned char **inc, P_INT *x, pwheel_t whl);
  * Arguments:
  *   P_INT x : number to check for primality
  *   pwheel_t whl : wheel to use to check for primality
- *      NOTE: The builtins PWHEEL_6 or PWHEEL_30 may be used for whl
+ *      NOTE: The builtins PWHEEL_6 to PWHEEL_30030 may be used for whl
  * 
  * Returns:
  *   int : Boolean indicating primality, 1 -> Is Prime ; 0 -> Is Composite
@@ -81,6 +353,7 @@ int is_prime_w(P_INT x, pwheel_t whl);
 
 /* Factorizes number using wheel factorization
  * Each call will return the next factor with its power
+ * NOTE: Not thread safe, use factor_init and factor_next instead
  * 
  * Usage:
  *   P_INT x = 540;   // 540 == (2 * 2) * (3 * 3 * 3) * 5
@@ -94,7 +367,7 @@ int is_prime_w(P_INT x, pwheel_t whl);
  *   P_INT x : number to factorize
  *      NOTE: Use x = 0 to get continued factors
  *   pwheel_t whl : wheel to use to check for primality
- *      NOTE: The builtins PWHEEL_6 or PWHEEL_30 may be used for whl
+ *      NOTE: The builtins PWHEEL_6 to PWHEEL_30030 may be used for whl
  *   int *pow : pointer to location to store power of prime factor
  * 
  * Returns:
@@ -103,6 +376,120 @@ int is_prime_w(P_INT x, pwheel_t whl);
  */
 P_INT factorize_w(P_INT x, pwheel_t whl, int *pow);
 
+/* State for factorizing a single number with wheel factorization
+ * Unlike factorize_w any number of these may be used at once
+ * so separate threads may factorize numbers at the same time
+ */
+typedef struct factor_ctx_s{
+	P_INT work;  // Part of the number left to factorize
+	P_INT factor;  // Next potential divisor once past the wheel primes
+	pwheel_t whl;  // Wheel in use or NULL once completely factored
+	unsigned char *num;  // Current wheel prime or increment
+	const struct tdiv_s *tdiv;  // Next prime of the trial division table to check or NULL once past it
+	int do_wheel_primes;  // Whether the wheel primes are still being checked
+} factor_ctx_t;
+
+/* Setup a context to factorize x using the given wheel
+ * 
+ * Usage:
+ *   factor_ctx_t ctx;
+ *   int pow;
+ *   factor_init(&ctx, 540, PWHEEL_6);
+ *   factor_next(&ctx, &pow);  // Returns 2 ; Sets pow = 2
+ *   factor_next(&ctx, &pow);  // Returns 3 ; Sets pow = 3
+ *   factor_next(&ctx, &pow);  // Returns 5 ; Sets pow = 1
+ *   factor_next(&ctx, &pow);  // Returns 0
+ * 
+ * Arguments:
+ *   factor_ctx_t *ctx : context to setup
+ *   P_INT x : number to factorize
+ *     NOTE: 0 and 1 have no factors
+ *   pwheel_t whl : wheel to use to generate potential divisors
+ */
+void factor_init(factor_ctx_t *ctx, P_INT x, pwheel_t whl);
+
+/* Find the next prime factor of the number given to factor_init
+ * 
+ * Arguments:
+ *   factor_ctx_t *ctx : context setup by factor_init
+ *   int *pow : pointer to location to store power of prime factor
+ * 
+ * Returns:
+ *   P_INT : prime factor or 0 if number is completely factored
+ *   int *pow : exponent on prime factor
+ */
+P_INT factor_next(factor_ctx_t *ctx, int *pow);
+
+/* Factorizes number completely using wheel factorization
+ * 
+ * Usage:
+ *   P_INT primes[RHO_MAX_FACTORS];
+ *   int pows[RHO_MAX_FACTORS];
+ *   factor_all(540, PWHEEL_30, primes, pows);  // Returns 3
+ *   // Sets primes = {2, 3, 5} and pows = {2, 3, 1}
+ * 
+ * Arguments:
+ *   P_INT x : number to factorize
+ *   pwheel_t whl : wheel to use to generate potential divisors
+ *   P_INT *primes : location to store the distinct prime factors
+ *     in ascending order, must have room for RHO_MAX_FACTORS elements
+ *   int *pows : location to store the exponent of each prime factor
+ * 
+ * Returns:
+ *   int : number of distinct prime factors found
+ */
+int factor_all(P_INT x, pwheel_t whl, P_INT *primes, int *pows);
+
+/* Factorizes number completely using trial division by small primes
+ * followed by Pollard's rho with Brent's cycle detection on the
+ * remaining composite parts. SQUFOF is used when rho fails to split
+ * a number. Composite parts are recognized using is_prime_mr64.
+ * 
+ * Usage:
+ *   P_INT primes[RHO_MAX_FACTORS];
+ *   int pows[RHO_MAX_FACTORS];
+ *   factorize_rho(18446744030759878681, primes, pows);  // Returns 1
+ *   // Sets primes = {4294967291} and pows = {2}
+ *   factorize_rho(540, primes, pows);  // Returns 3
+ *   // Sets primes = {2, 3, 5} and pows = {2, 3, 1}
+ * 
+ * Arguments:
+ *   P_INT x : number to factorize
+ *   P_INT *primes : location to store the distinct prime factors
+ *     in ascending order, must have room for RHO_MAX_FACTORS elements
+ *   int *pows : location to store the exponent of each prime factor
+ * 
+ * Returns:
+ *   int : number of distinct prime factors found
+ */
+int factorize_rho(P_INT x, P_INT *primes, int *pows);
+// Most distinct prime factors a 64-bit number can have
+#define RHO_MAX_FACTORS 15
+
+/* Factorizes every number in [lower, upper] with a segmented sieve.
+ * Each prime up to sqrt(upper) is divided out of its multiples in
+ * the current segment recording the factor in that number's list.
+ * Whatever remains afterwards is a single prime factor. This takes
+ * close to linear time in the size of the range unlike factorizing
+ * each number separately.
+ * 
+ * Usage:
+ *   void print(P_INT x, const P_INT *primes, const int *pows, int len, void *arg){
+ *       printf("%llu has %i prime factors\n", x, len);
+ *   }
+ *   factorize_range(1000, 2000, print, NULL);
+ * 
+ * Arguments:
+ *   P_INT lower : smallest number to factorize
+ *   P_INT upper : largest number to factorize
+ *   void (*emit)(P_INT, const P_INT*, const int*, int, void*) : function called
+ *     for each number in ascending order with its len distinct prime factors
+ *     in ascending order and their powers
+ *     NOTE: 0 and 1 are given no factors
+ *   void *arg : argument passed to every call of emit
+ */
+void factorize_range(P_INT lower, P_INT upper, void (*emit)(P_INT x, const P_INT *primes, const int *pows, int len, void *arg), void *arg);
+
 /* Check primality of x using Miller Rabin method
  * with wits as the witnesses. Because it is a probabilistic
  * method this method can have false positives
@@ -125,6 +512,63 @@ P_INT factorize_w(P_INT x, pwheel_t whl, int *pow);
  */
 int is_prime_mr(P_INT x, size_t wits_len, P_INT *wits);
 
+/* Deterministic Miller Rabin test for all 64-bit x. After trial
+ * division by the primes up to 37 x is checked against a fixed set
+ * of seven witnesses which has no strong pseudoprimes below 2^64.
+ * Uses Montgomery multiplication so no divisions are performed
+ * while exponentiating.
+ * 
+ * Usage:
+ *   is_prime_mr64(8911);  // 8911 composite => Returns 0
+ *   is_prime_mr64(18446744073709551557);  // Largest 64-bit prime => Returns 1
+ * 
+ * Arguments:
+ *   P_INT x : number to be checked for primality
+ * 
+ * Returns:
+ *   int : boolean value indicating if x is prime
+ */
+int is_prime_mr64(P_INT x);
+
+/* Deterministic Miller Rabin test of many numbers at once. Numbers
+ * which survive trial division are tested several at a time in
+ * lockstep. When compiled with AVX2 or AVX-512 groups of numbers
+ * below 2^32 are tested in vector registers using 32-bit Montgomery
+ * multiplication, otherwise the 64-bit multiplications of the group
+ * are interleaved. Gives the same results as is_prime_mr64.
+ * 
+ * Usage:
+ *   P_INT xs[] = {8911, 571, 18446744073709551557};
+ *   uint8_t out[3];
+ *   is_prime_mr_batch(xs, 3, out);  // Sets out = {0, 1, 1}
+ * 
+ * Arguments:
+ *   const P_INT *xs : numbers to be checked for primality
+ *   size_t n : number of elements in xs
+ *   uint8_t *out : location to store n boolean values indicating
+ *     if the corresponding element of xs is prime
+ */
+void is_prime_mr_batch(const P_INT *xs, size_t n, uint8_t *out);
+
+/* Check primality of x using the Baillie-PSW test. After trial
+ * division by the primes below 100 x must be a strong probable
+ * prime to base 2 and a strong Lucas probable prime with Selfridge's
+ * parameters P = 1, Q = (1 - D) / 4. No composite passes both below
+ * 2^64 so the test is deterministic for every P_INT, while costing
+ * about three Miller Rabin rounds in Montgomery arithmetic.
+ *
+ * Usage:
+ *   is_prime_bpsw(2047);  // Strong pseudoprime to base 2 => Returns 0
+ *   is_prime_bpsw(18446744073709551557);  // Largest 64-bit prime => Returns 1
+ *
+ * Arguments:
+ *   P_INT x : number to be checked for primality
+ *
+ * Returns:
+ *   int : boolean value indicating if x is prime
+ */
+int is_prime_bpsw(P_INT x);
+
 /* Check primality of x using Fermat's Algorithm
  * checking N = a^2 - b^2 for a between sqrt(N)
  * and sqrt(N) * (1 + above_sqrt).
@@ -143,4 +587,57 @@ int is_prime_mr(P_INT x, size_t wits_len, P_INT *wits);
  */
 int is_prime_fmt(P_INT x, pwheel_t whl, float above_sqrt);
 
+
+// Binary formats for lists of primes written by primes --format
+#define PRIME_FMT_DELTA_VARINT 1  // Gap from the prior prime (0 before the first) as unsigned LEB128
+#define PRIME_FMT_U64LE 2  // Each prime as an 8 byte little-endian word
+
+// Position in a binary list of primes
+typedef struct prime_reader_s{
+	const unsigned char *pos, *end;
+	P_INT last;  // Last prime read
+	int format;
+} prime_reader_t;
+
+/* Setup a reader over a binary list of primes held in memory
+ * 
+ * Usage:
+ *   prime_reader_t r;
+ *   P_INT p;
+ *   prime_reader_init(&r, buf, len, PRIME_FMT_DELTA_VARINT);
+ *   while(prime_reader_next(&r, &p) > 0) printf("%llu\n", p);
+ * 
+ * Arguments:
+ *   prime_reader_t *r : reader to setup
+ *   const void *buf : contents written by primes --format
+ *   size_t len : length of buf in bytes
+ *   int format : PRIME_FMT_DELTA_VARINT or PRIME_FMT_U64LE
+ */
+void prime_reader_init(prime_reader_t *r, const void *buf, size_t len, int format);
+
+/* Read the next prime from a binary list
+ * 
+ * Arguments:
+ *   prime_reader_t *r : reader setup by prime_reader_init
+ *   P_INT *p : location to store the prime
+ * 
+ * Returns:
+ *   int : 1 if a prime was read, 0 at the end of the list
+ *     or -1 if the list is truncated or malformed
+ */
+int prime_reader_next(prime_reader_t *r, P_INT *p);
+
+/* Decode up to max primes from a binary list at once
+ * 
+ * Arguments:
+ *   prime_reader_t *r : reader setup by prime_reader_init
+ *   P_INT *primes : location to store the primes
+ *   size_t max : most primes to store
+ * 
+ * Returns:
+ *   size_t : number of primes stored, fewer than max only at the
+ *     end of the list or where it is malformed
+ */
+size_t prime_reader_read(prime_reader_t *r, P_INT *primes, size_t max);
+
 #endif
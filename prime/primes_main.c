@@ -1,13 +1,20 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <math.h>
 
 // For argument parsing
 #include <errno.h>
 #include <getopt.h>
 #include <stdio.h>
+#include <unistd.h>
 
 #include "primes.h"
+#include "parallel.h"
+#include "output.h"
+#include "sieve_cache.h"
+#include "stats.h"
+#include "input.h"
 
 #define die(...) { fprintf(stderr, ##__VA_ARGS__); fprintf(stderr, "Call with -h or --help flag for more information\n"); exit(1); }
 
@@ -16,8 +23,15 @@ const char help_msg[] =
 	"Usage:  primes [OPTION...]  [-n] RANGE\n"
 	"   or:  primes [OPTION...]  -w WHEEL-SIZE [-n] RANGE\n"
 	"   or:  primes [OPTION...]  -f [-n] RANGE\n"
+	"   or:  primes [OPTION...]  -f -p [-n] RANGE\n"
+	"   or:  primes [OPTION...]  -f -s [-n] RANGE\n"
 	"   or:  primes [OPTION...]  -r FERMAT_PROP -w WHEEL-SIZE [-n] RANGE\n"
 	"   or:  primes [OPTION...]  -m WITNESS,[WITNESSES...] [-n] RANGE\n"
+	"   or:  primes [OPTION...]  -m auto [-n] RANGE\n"
+	"   or:  primes [OPTION...]  -b [-n] RANGE\n"
+	"   or:  primes [OPTION...]  -t | -T PATTERN | -G [-n] RANGE\n"
+	"   or:  primes [OPTION...]  -A MODULUS [-n] RANGE\n"
+	"   or:  primes [OPTION...]  [-f] -i FILE\n"
 	"\n"
 	"Check primality of ranges of integers using various tests\n"
 	"\n"
@@ -26,21 +40,66 @@ const char help_msg[] =
 	"                         Give the range of numbers to check for primality\n"
 	"  -w, --wheel WHEEL-SIZE Bound up to which primes will be used to create wheel\n"
 	"                         (e.g. '-w 6' will create a modulus of 2 * 3 * 5 = 30)\n"
+	"                         Wheels up to '-w 17' (modulus 30030) are prebuilt\n"
 	"  -r, --fermat PROP      Use Fermat's algorithm to check N = a^2 - b^2 with\n"
 	"                         `a` between sqrt(N) and sqrt(N) * (1 + PROP) where\n"
 	"                         PROP is a positive float\n"
 	"  -m, --miller-rabin WITNESS[,WITNESSES...]\n"
 	"                         Use the miller-rabin primality test with the given\n"
 	"                         witnesses (WARNING: probabilitistic, potentially wrong)\n"
+	"                         or with 'auto' use a fixed set of witnesses which is\n"
+	"                         deterministic for all 64-bit numbers\n"
+	"  -b, --bpsw             Use the Baillie-PSW test, a base 2 strong probable\n"
+	"                         prime test followed by a strong Lucas test, which\n"
+	"                         has no counterexamples below 2^64\n"
+	"  -j, --threads N        Number of threads to use for sieving, checking and\n"
+	"                         factorizing, 0 to use one per processor.\n"
+	"                         Defaults to 1.\n"
+	"  -s, --sieve            Use the Sieve of Eratosthenes, with -f the prime\n"
+	"                         factors of the whole range are found by sieving\n"
+	"  -p, --rho              Factorize using Pollard's rho with Brent's cycle\n"
+	"                         detection, falling back to SQUFOF (requires -f)\n"
 	"  -d, --delim STRING     String used to separate the list of primes\n"
 	"  -f, --factors          Factorize each number using given wheel, specified\n"
 	"                         using -w. Defaulting to a wheel for -w 4.\n"
 	"                         (NOTICE: can't be used with -q)\n"
 	"  -q, --quiet            Don't display list of primes\n"
 	"  -c, --count            Display the number of primes found in the range\n"
+	"  -F, --format FORMAT    Write primes as 'text' (default), 'delta-varint' for\n"
+	"                         the gap from the prior prime as unsigned LEB128\n"
+	"                         or 'u64le' for 8 byte little-endian words. With a\n"
+	"                         binary format the count is written to stderr.\n"
+	"  -C, --cache DIR        Keep the sieved segments in files in DIR so later\n"
+	"                         runs over the same numbers read them instead of\n"
+	"                         sieving again\n"
+	"  -t, --twins            List the twin primes p, p + 2 found by the sieve\n"
+	"  -T, --tuple PATTERN    List the prime k-tuples found by the sieve whose\n"
+	"                         members are at the ascending offsets of PATTERN\n"
+	"                         from the first (e.g. '0,2,6' for p, p + 2, p + 6)\n"
+	"  -G, --max-gaps         List each gap between consecutive primes p and q\n"
+	"                         which is larger than every gap before it in the\n"
+	"                         range as 'p q q-p'\n"
+	"                         (NOTICE: -t, -T and -G only use the sieve and the\n"
+	"                         count is of the tuples or gaps listed)\n"
+	"  -A, --aggregate MODULUS\n"
+	"                         Instead of listing the primes found by the sieve\n"
+	"                         print their sum, the sum of their squares modulo\n"
+	"                         MODULUS, a hash of the sequence and for MODULUS up\n"
+	"                         to 65536 the number of primes in each residue class\n"
+	"  -i, --input FILE       Check or factorize the numbers in FILE, or standard\n"
+	"                         input for '-', separated by whitespace or commas\n"
+	"                         instead of a range. Results are written in the order\n"
+	"                         of the input. Unless another method is given they\n"
+	"                         are checked with the Miller-Rabin test with 'auto'\n"
+	"                         witnesses and factorized with Pollard's rho.\n"
+	"  -S, --stats            Report the time, CPU time, peak memory, numbers per\n"
+	"                         second and bytes of each phase to stderr, with CPU\n"
+	"                         cycles and cache misses where perf events are allowed\n"
 	"  -h, --help             Give this help list\n"
 	"\n"
 	"If no other method is selected then the Sieve of Eratosthenes is used.\n"
+	"When only the count is requested (-q -c) for a large range the primes are\n"
+	"instead counted with Lucy_Hedgehog's method without sieving.\n"
 	"\n"
 ;
 
@@ -51,10 +110,42 @@ const char help_msg[] =
 #define METHOD_WHEEL 2
 #define METHOD_FERMAT 3
 #define METHOD_MILLER_RABIN 4
+#define METHOD_PRIME_COUNT 5
+#define METHOD_RHO 6
+#define METHOD_BPSW 7
 int method = NO_METHOD;
 
 // String printed between found primes
 const char *spacer = NULL;
+size_t spacer_len;
+
+// Buffered standard output
+#define OUT_BUF_SIZE (1 << 20)
+outbuf_t out;
+
+// Format primes are written in, either text or PRIME_FMT_DELTA_VARINT / PRIME_FMT_U64LE
+#define FORMAT_TEXT 0
+int format = FORMAT_TEXT;
+
+// Patterns of primes searched for in the sieve instead of listing every prime
+#define NO_PATTERN 0
+#define PATTERN_TUPLE 1
+#define PATTERN_GAPS 2
+int pattern = NO_PATTERN;
+w30_tuple_t tuple;
+
+// File of numbers to check or factorize instead of a range, "-" for standard input
+const char *input_path = NULL;
+// Batch of numbers read from the input
+#define INPUT_BATCH (1 << 16)
+P_INT *input_nums;
+
+// Modulus of the reductions printed with -A or 0 to list the primes
+P_INT aggregate_mod = 0;
+
+// Phase timings reported with -S
+stats_t stats;
+int show_stats = 0;
 
 // Lower and Upper bounds on integers
 P_INT lower = 0, upper = 0;
@@ -62,12 +153,13 @@ P_INT lower = 0, upper = 0;
 int do_factors = 0;  // Whether to attempt to factorize the numbers
 int quiet = 0;  // Whether to print out the primes
 int show_count = 0;  // Whether to print the number of primes found
+unsigned int threads = 1;  // Number of threads to use
 
 
 // Parameters for each method
 
 // For Sieve of Eratosthenes
-// None necessary
+const char *cache_dir = NULL;  // Directory of sieved segments kept between runs
 
 // For Wheel Factorization / Fermat Factorization
 size_t wheel_size = 4;
@@ -80,6 +172,7 @@ float fmt_prop;
 // Dynamic Array of witness elements
 size_t mr_wit_cap, mr_wit_len;
 P_INT *mr_wits = NULL;
+int mr_auto = 0;  // Whether to use the deterministic 64-bit witnesses
 
 
 struct option longopts[] = {
@@ -87,10 +180,22 @@ struct option longopts[] = {
 	{"wheel", required_argument, NULL, 'w'},
 	{"fermat", required_argument, NULL, 'r'},
 	{"miller-rabin", required_argument, NULL, 'm'},
+	{"bpsw", no_argument, NULL, 'b'},
+	{"sieve", no_argument, NULL, 's'},
+	{"rho", no_argument, NULL, 'p'},
+	{"threads", required_argument, NULL, 'j'},
 	{"delim", required_argument, NULL, 'd'},
 	{"factors", no_argument, NULL, 'f'},
 	{"quiet", no_argument, NULL, 'q'},
 	{"count", no_argument, NULL, 'c'},
+	{"format", required_argument, NULL, 'F'},
+	{"cache", required_argument, NULL, 'C'},
+	{"twins", no_argument, NULL, 't'},
+	{"tuple", required_argument, NULL, 'T'},
+	{"max-gaps", no_argument, NULL, 'G'},
+	{"aggregate", required_argument, NULL, 'A'},
+	{"input", required_argument, NULL, 'i'},
+	{"stats", no_argument, NULL, 'S'},
 	{"help", no_argument, NULL, 'h'},
 	{0}
 };
@@ -129,6 +234,11 @@ void parse_opts(int key){
 			if(method != NO_METHOD) die("Only one factorization / primality checking method may be specified\n");
 			method = METHOD_MILLER_RABIN;
 			
+			if(strcmp(optarg, "auto") == 0){
+				mr_auto = 1;
+				break;
+			}
+			
 			// Allocate space for witnesses
 			mr_wit_len = 0;  mr_wit_cap = 4;
 			mr_wits = malloc(mr_wit_cap * sizeof(P_INT));
@@ -141,12 +251,35 @@ void parse_opts(int key){
 				
 				// Try to parse witness
 				errno = 0;
-				mr_wits[mr_wit_len++] = strtoll(wit, &endptr, 10);
+				mr_wits[mr_wit_len++] = strtoull(wit, &endptr, 10);
 				if(errno || *endptr) die("Failed to parse Miller Rabin witness \"%s\"\n", wit);
 			}
 		break;
 		
 		
+		case 'b':
+			if(method != NO_METHOD) die("Only one factorization / primality checking method may be specified\n");
+			method = METHOD_BPSW;
+		break;
+		
+		case 's':
+			if(method != NO_METHOD) die("Only one factorization / primality checking method may be specified\n");
+			method = METHOD_ERATOS_SIEVE;
+		break;
+		
+		case 'p':
+			if(method != NO_METHOD) die("Only one factorization / primality checking method may be specified\n");
+			method = METHOD_RHO;
+		break;
+		
+		// Set number of threads
+		case 'j':
+			errno = 0;
+			threads = (unsigned int)strtoul(optarg, &endptr, 10);
+			if(errno || *endptr) die("Failed to parse number of threads \"%s\"\n", optarg);
+			if(threads == 0) threads = par_cpus();
+		break;
+		
 		// Set spacer characters
 		case 'd': spacer = optarg;
 		break;
@@ -161,6 +294,59 @@ void parse_opts(int key){
 		case 'c': show_count = 1;
 		break;
 		
+		// Set output format
+		case 'F':
+			if(strcmp(optarg, "text") == 0) format = FORMAT_TEXT;
+			else if(strcmp(optarg, "delta-varint") == 0) format = PRIME_FMT_DELTA_VARINT;
+			else if(strcmp(optarg, "u64le") == 0) format = PRIME_FMT_U64LE;
+			else die("Unknown output format \"%s\"\n", optarg);
+		break;
+		
+		// Keep sieved segments in a directory
+		case 'C': cache_dir = optarg;
+		break;
+		
+		// Search for patterns of primes
+		case 't':
+			if(pattern != NO_PATTERN) die("Only one pattern of primes may be searched for\n");
+			pattern = PATTERN_TUPLE;
+			w30_tuple_init(&tuple, (P_INT[]){0, 2}, 2);
+		break;
+		case 'T':
+			if(pattern != NO_PATTERN) die("Only one pattern of primes may be searched for\n");
+			pattern = PATTERN_TUPLE;
+			
+			P_INT offs[W30_TUPLE_MAX];
+			size_t len = 0;
+			for(char *off = strtok(optarg, ","); off; off = strtok(NULL, ",")){
+				if(len == W30_TUPLE_MAX) die("Patterns may have at most %d offsets\n", W30_TUPLE_MAX);
+				errno = 0;
+				offs[len++] = strtoull(off, &endptr, 10);
+				if(errno || *endptr) die("Failed to parse pattern offset \"%s\"\n", off);
+			}
+			if(w30_tuple_init(&tuple, offs, len)) die("Pattern offsets must be ascending and start from 0\n");
+		break;
+		case 'G':
+			if(pattern != NO_PATTERN) die("Only one pattern of primes may be searched for\n");
+			pattern = PATTERN_GAPS;
+		break;
+		
+		// Reduce the primes instead of listing them
+		case 'A':
+			errno = 0;
+			aggregate_mod = strtoull(optarg, &endptr, 10);
+			if(errno || *endptr) die("Failed to parse aggregate modulus \"%s\"\n", optarg);
+			if(aggregate_mod == 0) die("Aggregate modulus must be positive\n");
+		break;
+		
+		// Read the numbers from a file
+		case 'i': input_path = optarg;
+		break;
+		
+		// Report statistics for each phase
+		case 'S': show_stats = 1;
+		break;
+		
 		// Print help message
 		case 'h':
 			puts(help_msg);
@@ -185,7 +371,7 @@ void parse_bounds(char *arg){
 		*colon = '\0';
 		// Try to parse upper bound
 		errno = 0;
-		upper = strtoll(colon + 1, NULL, 10);
+		upper = strtoull(colon + 1, NULL, 10);
 		if(errno) die("Failed to parse upper bound \"%s\"\n", colon + 1);
 		
 		// Try to parse lower bound
@@ -193,12 +379,12 @@ void parse_bounds(char *arg){
 			lower = 1;
 		}else{
 			errno = 0;
-			lower = strtoll(arg, NULL, 10);
+			lower = strtoull(arg, NULL, 10);
 			if(errno) die("Failed to parse lower bound \"%s\"\n", arg);
 		}
 	}else{ // Format = NUMBER
 		errno = 0;
-		upper = strtoll(arg, NULL, 10);
+		upper = strtoull(arg, NULL, 10);
 		if(errno) die("Failed to parse single number \"%s\"\n", arg);
 		lower = upper;
 	}
@@ -211,9 +397,10 @@ void parse_bounds(char *arg){
 
 
 // Functions to check primality
-// Store results of Sieve of Eratosthenes
-BIT_TYPE *sieve_isprime = NULL;
-int sieve_check(P_INT x){ return getbit(sieve_isprime, x); }
+// Store results of Sieve of Eratosthenes in a wheel bit array starting from sieve_base
+unsigned char *sieve_isprime = NULL;
+P_INT sieve_base;
+int sieve_check(P_INT x){ return x < 7 ? x == 2 || x == 3 || x == 5 : getbit30(sieve_isprime, x - sieve_base); }
 
 // Trial division with Wheel function
 int wheel_check(P_INT x){ return is_prime_w(x, whl); }
@@ -223,92 +410,665 @@ int fermat_check(P_INT x){ return is_prime_fmt(x, whl, fmt_prop); }
 
 // Miller Rabin Test
 int miller_rabin_check(P_INT x){ return is_prime_mr(x, mr_wit_len, mr_wits); }
+int miller_rabin_auto_check(P_INT x){ return is_prime_mr64(x); }
+
+// Baillie-PSW Test
+int bpsw_check(P_INT x){ return is_prime_bpsw(x); }
+
+
+// Output buffered by one task of par_range
+struct range_out_s{
+	outbuf_t buf;
+	P_INT items;  // Primes or factorizations written
+	P_INT first, last;  // First and last prime written
+	size_t head;  // Bytes of the first prime, rewritten once the prime before it is known
+};
+
+// Append prime x to out in the chosen format, prev is the prime written before x or 0
+void put_prime(outbuf_t *out, P_INT x, P_INT prev){
+	switch(format){
+		case FORMAT_TEXT:
+			if(prev) outbuf_put(out, spacer, spacer_len);
+			outbuf_u64(out, x);
+		break;
+		case PRIME_FMT_DELTA_VARINT: outbuf_varint(out, x - prev);
+		break;
+		case PRIME_FMT_U64LE: outbuf_u64le(out, x);
+		break;
+	}
+}
+
+// Append a prime to the output of a task
+void range_put(struct range_out_s *o, P_INT x){
+	if(quiet) return;
+	
+	// The first prime is written as if nothing came before it
+	put_prime(&o->buf, x, o->items ? o->last : 0);
+	if(!o->items++){
+		o->first = x;
+		o->head = o->buf.len;
+	}
+	o->last = x;
+}
+
+
+// Pointer to method to use to check each number for primality
+int (*check)(P_INT) = NULL;
+
+// Print and count the primes in [from, to]
+P_INT check_range(P_INT from, P_INT to, struct range_out_s *o){
+	P_INT count = 0;
+	for(P_INT i = from; ; i++){
+		if(check(i)){
+			range_put(o, i);
+			count++;
+		}
+		
+		// Stop before i wraps around after the largest 64-bit number
+		if(i == to) break;
+	}
+	return count;
+}
+
+// Print and count the primes among the input numbers input_nums[from] to input_nums[to]
+P_INT check_list(P_INT from, P_INT to, struct range_out_s *o){
+	P_INT count = 0;
+	for(P_INT i = from; i <= to; i++){
+		if(check(input_nums[i])){
+			range_put(o, input_nums[i]);
+			count++;
+		}
+	}
+	return count;
+}
+
+// Print the primes in [from, to] by walking the set bits of the sieve
+P_INT sieve_range(P_INT from, P_INT to, struct range_out_s *o){
+	P_INT count = 0, x;
+	for(x = from; x < 7 && x <= to; x++) if(sieve_check(x)){
+		range_put(o, x);
+		count++;
+	}
+	if(x > to) return count;
+	
+	// Bits outside [lower, upper] are already cleared so only the chunk edges are checked
+	for(P_INT k = (x - sieve_base) / 30; k <= (to - sieve_base) / 30; k++){
+		for(unsigned int bits = sieve_isprime[k]; bits; bits &= bits - 1){
+			x = sieve_base + 30 * k + W30_RESIDUE[__builtin_ctz(bits)];
+			if(x < from || x > to) continue;
+			
+			range_put(o, x);
+			count++;
+		}
+	}
+	return count;
+}
+
+
+// Print the members of the tuple starting from p
+void tuple_print(P_INT p, void *arg){
+	struct range_out_s *o = arg;
+	if(o->items++) outbuf_put(&o->buf, spacer, spacer_len);
+	for(size_t j = 0; j < tuple.len; j++){
+		if(j) outbuf_put(&o->buf, " ", 1);
+		outbuf_u64(&o->buf, p + tuple.offs[j]);
+	}
+}
+
+// Print and count the tuples starting in [from, to] found in the sieve
+P_INT tuple_range(P_INT from, P_INT to, struct range_out_s *o){
+	return w30_tuples(sieve_isprime, sieve_base, upper, from, to, &tuple, quiet ? NULL : tuple_print, o);
+}
+
+
+// Number of candidates given to is_prime_mr_batch at a time
+#define MR_BATCH 4096
+
+// Print and count the primes in [from, to] with the batched Miller Rabin test
+// Only numbers coprime to 30 and the numbers below 7 are tested
+P_INT miller_rabin_batch_range(P_INT from, P_INT to, struct range_out_s *o){
+	P_INT cands[MR_BATCH], count = 0;
+	uint8_t res[MR_BATCH];
+	size_t k, len = 0;
+	
+	for(P_INT i = from; ; i++){
+		int last = i == to;
+		if(i < 7 || W30_BIT[i % 30] < 8) cands[len++] = i;
+		
+		if(len == MR_BATCH || last){
+			is_prime_mr_batch(cands, len, res);
+			for(k = 0; k < len; k++) if(res[k]){
+				range_put(o, cands[k]);
+				count++;
+			}
+			len = 0;
+		}
+		if(last) break;
+	}
+	return count;
+}
+
+
+// Print and count the primes among the input numbers input_nums[from] to input_nums[to]
+// with the batched Miller Rabin test
+P_INT miller_rabin_batch_list(P_INT from, P_INT to, struct range_out_s *o){
+	P_INT count = 0, i, k;
+	uint8_t res[MR_BATCH];
+	
+	for(i = from; i <= to; i += MR_BATCH){
+		size_t len = to - i + 1 < MR_BATCH ? to - i + 1 : MR_BATCH;
+		is_prime_mr_batch(input_nums + i, len, res);
+		for(k = 0; k < len; k++) if(res[k]){
+			range_put(o, input_nums[i + k]);
+			count++;
+		}
+	}
+	return count;
+}
 
 
 // Functions to factorize numbers
 // Trial division with Wheel function
-P_INT wheel_factors(P_INT x, int *pow){ return factorize_w(x, whl, pow); }
+int wheel_factors(P_INT x, P_INT *primes, int *pows){ return factor_all(x, whl, primes, pows); }
+
+// Pointer to method to use to factorize each number with
+int (*factors)(P_INT, P_INT*, int*) = NULL;
+
+// Print a number followed by its factors as "x : p^e * q"
+void print_factors(outbuf_t *out, P_INT x, const P_INT *primes, const int *pows, int len){
+	outbuf_u64(out, x);
+	outbuf_put(out, " : ", 3);
+	
+	for(int k = 0; k < len; k++){
+		if(k) outbuf_put(out, " * ", 3);
+		outbuf_u64(out, primes[k]);
+		if(pows[k] != 1){
+			outbuf_put(out, "^", 1);
+			outbuf_u64(out, (P_INT)pows[k]);
+		}
+	}
+}
+
+// Print the factors of every number in [from, to]
+// Only the first factorization is written without a spacer before it
+P_INT factors_range(P_INT from, P_INT to, struct range_out_s *o){
+	P_INT primes[RHO_MAX_FACTORS];
+	int pows[RHO_MAX_FACTORS];
+	
+	for(P_INT i = from; ; i++){
+		int len = factors(i, primes, pows);
+		if(o->items++) outbuf_put(&o->buf, spacer, spacer_len);
+		print_factors(&o->buf, i, primes, pows, len);
+		
+		// Stop before i wraps around after the largest 64-bit number
+		if(i == to) break;
+	}
+	return to - from + 1;
+}
+
+
+// Print the factors of the input numbers input_nums[from] to input_nums[to]
+P_INT factors_list(P_INT from, P_INT to, struct range_out_s *o){
+	P_INT primes[RHO_MAX_FACTORS];
+	int pows[RHO_MAX_FACTORS];
+	
+	for(P_INT i = from; i <= to; i++){
+		int len = factors(input_nums[i], primes, pows);
+		if(o->items++) outbuf_put(&o->buf, spacer, spacer_len);
+		print_factors(&o->buf, input_nums[i], primes, pows, len);
+	}
+	return to - from + 1;
+}
+
+
+// Print a number and the factors found for it by factorize_range
+void sieve_factors_print(P_INT x, const P_INT *primes, const int *pows, int len, void *arg){
+	int *first = arg;
+	if(!*first) outbuf_put(&out, spacer, spacer_len);
+	*first = 0;
+	print_factors(&out, x, primes, pows, len);
+}
+
+
+
+// Numbers given to each task when a range is split between threads
+#define PAR_CHUNK 4096
+// Larger tasks for methods which spend little time on each number
+#define PAR_CHUNK_FAST (1 << 20)
+// Tasks per thread in each round which bounds the output held in memory
+#define PAR_ROUND 4
+
+// Shared state for running a function over chunks of [from, to]
+struct range_job_s{
+	P_INT from, to;
+	P_INT first;  // Index of the first chunk of the current round
+	P_INT chunk;  // Numbers in each chunk
+	struct range_out_s *outs;  // Output of each chunk in the round
+	P_INT *counts;
+	P_INT (*run)(P_INT, P_INT, struct range_out_s*);
+};
+
+void range_chunk(size_t k, void *arg){
+	struct range_job_s *job = arg;
+	P_INT from = job->from + (job->first + k) * job->chunk;
+	P_INT to = job->to - from < job->chunk ? job->to : from + job->chunk - 1;
+	
+	struct range_out_s *o = job->outs + k;
+	o->buf.len = o->head = 0;
+	o->items = 0;
+	job->counts[k] = job->run(from, to, o);
+}
+
+// Last prime written by par_range and whether it has written anything
+P_INT range_prev = 0;
+int range_written = 0;
+
+/* Run a function over [from, to] split into chunks shared between threads
+ * The output of each chunk is written in ascending order once the round is done
+ * run(from, to, o) adds its primes with range_put or writes whole items
+ * separated by spacer and returns a count
+ * The head of each chunk is rewritten from the end of the chunk before it,
+ * including the first chunk from the output of the call before
+ */
+P_INT par_range(P_INT (*run)(P_INT, P_INT, struct range_out_s*), P_INT from, P_INT to, P_INT chunk){
+	P_INT nchunks = (to - from) / chunk + 1, count = 0;
+	size_t k, round = (size_t)threads * PAR_ROUND;
+	if(round > nchunks) round = nchunks;
+	
+	struct range_job_s job = {from, to, 0, chunk, malloc(round * sizeof(struct range_out_s)), malloc(round * sizeof(P_INT)), run};
+	for(k = 0; k < round; k++) outbuf_init(&job.outs[k].buf, -1, 1 << 12);
+	struct iovec *iov = malloc(2 * round * sizeof(struct iovec));
+	size_t *heads = malloc(round * sizeof(size_t));
+	
+	// Anything printed before must come first
+	if(outbuf_flush(&out)) die("Failed to write output: %s\n", strerror(out.err));
+	
+	for(; job.first < nchunks; job.first += round){
+		size_t len = nchunks - job.first < round ? nchunks - job.first : round;
+		stats_begin(&stats, STATS_CHECK);
+		par_for(len, threads, range_chunk, &job);
+		P_INT last = job.first + len == nchunks ? to : from + (job.first + len) * chunk - 1;
+		stats_end(&stats, last - (from + job.first * chunk) + 1);
+		for(k = 0; k < len; k++) count += job.counts[k];
+		
+		stats_begin(&stats, STATS_OUTPUT);
+		
+		// Join each chunk to the one before it in the standard output buffer
+		// Make room first so the buffer isn't flushed in between
+		size_t cnt = 0, bytes = 0;
+		outbuf_room(&out, len * (spacer_len + 20));
+		if(out.err) die("Failed to write output: %s\n", strerror(out.err));
+		for(k = 0; k < len; k++){
+			struct range_out_s *o = job.outs + k;
+			heads[k] = out.len;
+			if(!o->items) continue;
+			
+			if(o->head){
+				put_prime(&out, o->first, range_prev);
+				range_prev = o->last;
+			}else if(range_written){
+				outbuf_put(&out, spacer, spacer_len);
+			}
+			range_written = 1;
+		}
+		
+		// Write the joins and bodies of the chunks in order
+		for(k = 0; k < len; k++){
+			struct range_out_s *o = job.outs + k;
+			if(!o->items) continue;
+			
+			size_t end = k + 1 < len ? heads[k + 1] : out.len;
+			iov[cnt++] = (struct iovec){out.buf + heads[k], end - heads[k]};
+			iov[cnt++] = (struct iovec){o->buf.buf + o->head, o->buf.len - o->head};
+			bytes += end - heads[k] + o->buf.len - o->head;
+		}
+		if(outbuf_writev(out.fd, iov, cnt)) die("Failed to write output: %s\n", strerror(errno));
+		out.written += bytes;
+		out.len = 0;
+		stats_end(&stats, 0);
+	}
+	
+	for(k = 0; k < round; k++) outbuf_free(&job.outs[k].buf);
+	free(job.outs);
+	free(job.counts);
+	free(iov);
+	free(heads);
+	return count;
+}
+
+
+/* Run a function over the numbers of the input a batch at a time as par_range
+ * does over a range, run(from, to, o) is given the indices of input_nums to use
+ * and the results are written in the order of the input
+ */
+P_INT par_input(P_INT (*run)(P_INT, P_INT, struct range_out_s*), P_INT chunk){
+	inbuf_t in;
+	if(inbuf_open(&in, input_path)) die("Failed to open input \"%s\"\n", input_path);
+	input_nums = malloc(INPUT_BATCH * sizeof(P_INT));
+	
+	P_INT count = 0;
+	ptrdiff_t n;
+	for(;;){
+		stats_begin(&stats, STATS_INPUT);
+		n = inbuf_read(&in, input_nums, INPUT_BATCH);
+		stats_end(&stats, n > 0 ? n : 0);
+		if(n <= 0) break;
+		count += par_range(run, 0, (P_INT)n - 1, chunk);
+	}
+	if(n < 0) die("Failed to read a number at byte %zu of \"%s\"\n", in.offset + in.pos, input_path);
+	
+	free(input_nums);
+	inbuf_close(&in);
+	return count;
+}
+
+
+// Gaps found in one chunk of the range that are larger than every gap before them in the chunk
+struct gap_chunk_s{
+	P_INT first, last;  // Smallest and largest primes of the chunk, 0 if none
+	P_INT *recs;  // Pairs of consecutive primes p, q
+	size_t len, cap;
+};
+
+// Shared state for finding the record gaps of chunks of [lower, upper]
+struct gap_job_s{
+	P_INT first;  // Index of the first chunk of the current round
+	P_INT chunk;  // Numbers in each chunk
+	struct gap_chunk_s *chunks;
+};
+
+void gap_add(P_INT p, P_INT q, void *arg){
+	struct gap_chunk_s *c = arg;
+	if(c->len + 2 > c->cap) c->recs = realloc(c->recs, (c->cap = c->cap ? 2 * c->cap : 16) * sizeof(P_INT));
+	c->recs[c->len++] = p;
+	c->recs[c->len++] = q;
+}
 
+void gap_chunk(size_t k, void *arg){
+	struct gap_job_s *job = arg;
+	P_INT from = lower + (job->first + k) * job->chunk;
+	P_INT to = upper - from < job->chunk ? upper : from + job->chunk - 1;
+	
+	struct gap_chunk_s *c = job->chunks + k;
+	c->len = 0;
+	w30_gaps(sieve_isprime, sieve_base, from, to, 0, &c->first, &c->last, gap_add, c);
+}
+
+// Print a gap as "p q q-p"
+void gap_print(P_INT p, P_INT q, P_INT *count){
+	if((*count)++) outbuf_put(&out, spacer, spacer_len);
+	outbuf_u64(&out, p);
+	outbuf_put(&out, " ", 1);
+	outbuf_u64(&out, q);
+	outbuf_put(&out, " ", 1);
+	outbuf_u64(&out, q - p);
+}
+
+/* Print and count the gaps between consecutive primes of the sieve
+ * which are larger than every gap before them in [lower, upper]
+ * Chunks are searched in parallel for the gaps that are records within
+ * them, the records of the whole range are among those and the gaps
+ * between the chunks, which are picked out in order
+ */
+P_INT max_gaps(P_INT chunk){
+	P_INT nchunks = (upper - lower) / chunk + 1, count = 0, max = 0, prev = 0;
+	size_t k, j, round = (size_t)threads * PAR_ROUND;
+	if(round > nchunks) round = nchunks;
+	
+	struct gap_job_s job = {0, chunk, calloc(round, sizeof(struct gap_chunk_s))};
+	for(; job.first < nchunks; job.first += round){
+		size_t len = nchunks - job.first < round ? nchunks - job.first : round;
+		stats_begin(&stats, STATS_CHECK);
+		par_for(len, threads, gap_chunk, &job);
+		P_INT last = job.first + len == nchunks ? upper : lower + (job.first + len) * chunk - 1;
+		stats_end(&stats, last - (lower + job.first * chunk) + 1);
+		
+		stats_begin(&stats, STATS_OUTPUT);
+		for(k = 0; k < len; k++){
+			struct gap_chunk_s *c = job.chunks + k;
+			if(!c->first) continue;
+			
+			if(prev && c->first - prev > max){
+				max = c->first - prev;
+				if(!quiet) gap_print(prev, c->first, &count);
+				else count++;
+			}
+			for(j = 0; j < c->len; j += 2){
+				if(c->recs[j + 1] - c->recs[j] <= max) continue;
+				max = c->recs[j + 1] - c->recs[j];
+				if(!quiet) gap_print(c->recs[j], c->recs[j + 1], &count);
+				else count++;
+			}
+			prev = c->last;
+		}
+		stats_end(&stats, 0);
+	}
+	
+	for(k = 0; k < round; k++) free(job.chunks[k].recs);
+	free(job.chunks);
+	return count;
+}
+
+
+// Reductions of one chunk of the range for each task of a round
+struct agg_job_s{
+	P_INT first;  // Index of the first chunk of the current round
+	P_INT chunk;  // Numbers in each chunk
+	prime_agg_t *aggs;
+};
+
+void agg_chunk(size_t k, void *arg){
+	struct agg_job_s *job = arg;
+	P_INT from = lower + (job->first + k) * job->chunk;
+	P_INT to = upper - from < job->chunk ? upper : from + job->chunk - 1;
+	
+	prime_agg_clear(job->aggs + k);
+	w30_aggregate(sieve_isprime, sieve_base, from, to, job->aggs + k);
+}
+
+// Reduce the primes of the sieve in chunks shared between threads, joining them in order
+void aggregate(prime_agg_t *total, P_INT chunk){
+	P_INT nchunks = (upper - lower) / chunk + 1;
+	size_t k, round = (size_t)threads * PAR_ROUND;
+	if(round > nchunks) round = nchunks;
+	
+	struct agg_job_s job = {0, chunk, malloc(round * sizeof(prime_agg_t))};
+	for(k = 0; k < round; k++) prime_agg_init(job.aggs + k, total->mod);
+	for(; job.first < nchunks; job.first += round){
+		size_t len = nchunks - job.first < round ? nchunks - job.first : round;
+		stats_begin(&stats, STATS_CHECK);
+		par_for(len, threads, agg_chunk, &job);
+		for(k = 0; k < len; k++) prime_agg_join(total, job.aggs + k);
+		P_INT last = job.first + len == nchunks ? upper : lower + (job.first + len) * chunk - 1;
+		stats_end(&stats, last - (lower + job.first * chunk) + 1);
+	}
+	
+	for(k = 0; k < round; k++) prime_agg_free(job.aggs + k);
+	free(job.aggs);
+}
+
+// Print the reductions of the primes
+void print_aggregate(const prime_agg_t *agg){
+	// The sum may be larger than a word so print it as 19 digit halves
+	const P_INT half = 10000000000000000000ULL;
+	if(agg->sum >= half) printf("Sum: %llu%019llu\n", (P_INT)(agg->sum / half), (P_INT)(agg->sum % half));
+	else printf("Sum: %llu\n", (P_INT)agg->sum);
+	printf("Sum of squares mod %llu: %llu\n", agg->mod, agg->sum_sq);
+	printf("Hash: %016llx\n", agg->hash);
+	
+	// Only the residue classes holding primes are listed
+	if(agg->hist){
+		printf("Residues mod %llu:\n", agg->mod);
+		for(P_INT r = 0; r < agg->mod; r++) if(agg->hist[r]) printf("%llu: %llu\n", r, agg->hist[r]);
+	}
+}
 
 
 int main(int argc, char *argv[]){
 	// Parse options
 	int c;
-	while((c = getopt_long(argc, argv, "-n:w:r:m:d:fqc", longopts, NULL)) >= 0) parse_opts(c);
+	while((c = getopt_long(argc, argv, "-n:w:r:m:bspj:d:fqcF:C:StT:GA:i:", longopts, NULL)) >= 0) parse_opts(c);
 	
 	// Check for valid bounds
 	if(upper < lower) die("Upper Bound must be greater than Lower Bound but %u < %u\n", upper, lower);
-	if(upper == 0 || lower == 0) die("Bounds or Number must be provided\n");
+	if((upper == 0 || lower == 0) && !input_path) die("Bounds or Number must be provided\n");
+	
+	stats_init(&stats, show_stats);
 	
 	// Generate wheel from size
+	stats_begin(&stats, STATS_WHEEL);
 	if(wheel_size == 3 || wheel_size == 4) whl = PWHEEL_6;
-	else if(wheel_size == 5 || wheel_size == 6) whl = PWHEEL_30;
+	else if(wheel_size >= 5 && wheel_size <= 7) whl = PWHEEL_30;
+	else if(wheel_size >= 8 && wheel_size <= 11) whl = PWHEEL_210;
+	else if(wheel_size == 12 || wheel_size == 13) whl = PWHEEL_2310;
+	else if(wheel_size >= 14 && wheel_size <= 17) whl = PWHEEL_30030;
 	else whl = make_pwheel((unsigned char)(wheel_size > 30 ? 30 : wheel_size));
+	stats_end(&stats, 0);
 	
 	// Set default separator
 	if(!spacer) spacer = "\n";
+	spacer_len = strlen(spacer);
+	
+	outbuf_init(&out, STDOUT_FILENO, OUT_BUF_SIZE);
+	
+	// Count without sieving when only the count is needed and sieving the
+	// range would cost more than the O(x^(3/4)) combinatorial method,
+	// unless a cache was given which only the sieve reads and fills
+	if(method == NO_METHOD && !do_factors && pattern == NO_PATTERN && !aggregate_mod && !input_path && !cache_dir && quiet && show_count){
+		if((double)(upper - lower) / threads > 2 * pow((double)upper, 0.75)) method = METHOD_PRIME_COUNT;
+	}
+	
+	// Numbers from the input may be anywhere below 2^64 so by default they are checked with
+	// the deterministic Miller Rabin test and factorized with Pollard's rho, not trial division
+	if(input_path){
+		if(pattern != NO_PATTERN || aggregate_mod) die("Only ranges can be searched for patterns or aggregated\n");
+		if(method == METHOD_ERATOS_SIEVE) die("The sieve can only be used on a range\n");
+		if(format == PRIME_FMT_DELTA_VARINT) die("Numbers from the input can't be written as delta-varint as they may not ascend\n");
+		if(method == NO_METHOD && do_factors) method = METHOD_RHO;
+		else if(method == NO_METHOD){
+			method = METHOD_MILLER_RABIN;
+			mr_auto = 1;
+		}
+	}
 	
 	// Set default method to Sieve of Eratosthenes
 	if(method == NO_METHOD) method = do_factors ? METHOD_WHEEL : METHOD_ERATOS_SIEVE;
 	
 	// Set functions to use according to method
 	P_INT count = 0;
+	if(aggregate_mod){
+		if(do_factors || pattern != NO_PATTERN) die("Only the primes themselves can be aggregated\n");
+		if(method != METHOD_ERATOS_SIEVE) die("Primes can only be aggregated with the sieve\n");
+		if(format != FORMAT_TEXT) die("Aggregates can only be written as text\n");
+	}
+	if(pattern != NO_PATTERN){
+		if(do_factors) die("Patterns of primes can't be factorized\n");
+		if(method != METHOD_ERATOS_SIEVE) die("Patterns of primes can only be found with the sieve\n");
+		if(format != FORMAT_TEXT) die("Patterns of primes can only be written as text\n");
+	}
 	if(do_factors){
-		P_INT (*factors)(P_INT, int*);  // Pointer to method to use to factorize number with
+		if(format != FORMAT_TEXT) die("Factors can only be written as text\n");
 		switch(method){
 			case METHOD_WHEEL: factors = wheel_factors;
 			break;
-			
+			case METHOD_RHO: factors = factorize_rho;
+			break;
 			case METHOD_ERATOS_SIEVE:
+				// Factorize the whole range at once
+				stats_begin(&stats, STATS_SIEVE);
+				factorize_range(lower, upper, sieve_factors_print, &(int){1});
+				count = upper - lower + 1;
+				stats_end(&stats, count);
+			break;
+			
+			case METHOD_PRIME_COUNT:
 			case METHOD_FERMAT:
 			case METHOD_MILLER_RABIN:
+			case METHOD_BPSW:
 				die("Method cannot be used to factorize number(s)\n");
 		}
 		
-		const char *sep = "";
-		for(P_INT i = lower; i <= upper; i++){
-			printf("%s%llu : ", sep, i);
-			count++;
-			sep = spacer;
-			
-			// Get and print factors
-			const char *fac_sep = "";
-			int pow = 0;
-			for(P_INT fac = factors(i, &pow); fac; fac = factors(0, &pow)){
-				printf(pow == 1 ? "%s%llu" : "%s%llu^%i", fac_sep, fac, pow);
-				fac_sep = " * ";
-			}
-		}
+		// Each number is factorized independently so split the range between threads
+		if(factors && input_path) count = par_input(factors_list, PAR_CHUNK);
+		else if(factors) count = par_range(factors_range, lower, upper, PAR_CHUNK);
 	}else{
-		int (*check)(P_INT);  // Pointeri to method to use to check for primality
 		switch(method){
 			case METHOD_WHEEL: check = wheel_check;
 			break;
 			case METHOD_ERATOS_SIEVE:
-				sieve_isprime = malloc(byte_size(upper + 1));  // Allocate sieve
-				prime_sieve_bs((bits_t)sieve_isprime, upper + 1);  // Perform sieving before printing
+				sieve_base = lower - lower % 30;
+				sieve_isprime = malloc(w30_size(upper - sieve_base + 1));  // Allocate sieve for only the range
+				// Perform sieving before printing
+				stats_begin(&stats, STATS_SIEVE);
+				if(cache_dir) count = prime_sieve_w30_cache(sieve_isprime, lower, upper, threads, cache_dir);
+				else count = prime_sieve_w30_mt(sieve_isprime, lower, upper, threads);
+				stats_end(&stats, upper - lower + 1);
+				stats.phase[STATS_SIEVE].alloc = w30_size(upper - sieve_base + 1);
 				check = sieve_check;
 			break;
 			case METHOD_FERMAT: check = fermat_check;
 			break;
-			case METHOD_MILLER_RABIN: check = miller_rabin_check;
+			case METHOD_MILLER_RABIN: check = mr_auto ? miller_rabin_auto_check : miller_rabin_check;
+			break;
+			case METHOD_BPSW: check = bpsw_check;
 			break;
+			case METHOD_PRIME_COUNT:
+				// Counting doesn't visit each number so no numbers are given for a rate
+				stats_begin(&stats, STATS_COUNT);
+				count = prime_count(upper);
+				if(upper >= 3 && !count) die("Failed to allocate memory to count primes\n");
+				if(lower > 1){
+					P_INT below = prime_count(lower - 1);
+					if(lower - 1 >= 3 && !below) die("Failed to allocate memory to count primes\n");
+					count -= below;
+				}
+				stats_end(&stats, 0);
+			break;
+			case METHOD_RHO:
+				die("Pollard's rho can only be used to factorize number(s)\n");
 		}
 		
-		// Check for primality on range
-		const char *sep = "";
-		for(P_INT i = lower; i <= upper; i++) if(check(i)){
-			if(!quiet) printf("%s%llu", sep, i);
-			count++;
-			sep = spacer;
+		// Check for primality on range split between threads
+		// The sieve already counts its primes so only check when they will be printed
+		if(input_path){
+			count = par_input(method == METHOD_MILLER_RABIN && mr_auto ? miller_rabin_batch_list : check_list, PAR_CHUNK);
+		}else if(method == METHOD_MILLER_RABIN && mr_auto){
+			count = par_range(miller_rabin_batch_range, lower, upper, PAR_CHUNK_FAST);
+		}else if(aggregate_mod){
+			prime_agg_t agg;
+			prime_agg_init(&agg, aggregate_mod);
+			aggregate(&agg, PAR_CHUNK_FAST);
+			
+			stats_begin(&stats, STATS_OUTPUT);
+			if(outbuf_flush(&out)) die("Failed to write output: %s\n", strerror(out.err));
+			print_aggregate(&agg);
+			// The reductions go through stdio rather than out so check it separately
+			if(fflush(stdout) || ferror(stdout)) die("Failed to write output: %s\n", strerror(errno));
+			stats_end(&stats, 0);
+			prime_agg_free(&agg);
+		}else if(pattern == PATTERN_TUPLE){
+			count = par_range(tuple_range, lower, upper, PAR_CHUNK_FAST);
+		}else if(pattern == PATTERN_GAPS){
+			count = max_gaps(PAR_CHUNK_FAST);
+		}else if(method == METHOD_ERATOS_SIEVE){
+			if(!quiet) par_range(sieve_range, lower, upper, PAR_CHUNK_FAST);
+		}else if(check){
+			count = par_range(check_range, lower, upper, PAR_CHUNK);
 		}
 	}
 	
-	if(!quiet) putchar('\n');
+	stats_begin(&stats, STATS_OUTPUT);
+	if(!quiet && !aggregate_mod && format == FORMAT_TEXT) outbuf_put(&out, "\n", 1);
+	stats.phase[STATS_OUTPUT].written = out.written + out.len;
+	if(outbuf_flush(&out)) die("Failed to write output: %s\n", strerror(out.err));
+	outbuf_free(&out);
+	stats_end(&stats, 0);
 	
-	// Print count if requested
-	if(show_count) printf("Count: %llu\n", count);
+	// Print count if requested, keeping it out of binary output
+	if(show_count) fprintf(format == FORMAT_TEXT ? stdout : stderr, "Count: %llu\n", count);
 	
+	stats_print(&stats, stderr);
+	stats_free(&stats);
 	return 0;
 }
 
@@ -0,0 +1,917 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <malloc.h>
+
+#include "primes.h"
+#include "output.h"
+#include "sieve_cache.h"
+#include "input.h"
+
+// Print result of a single test and return 1 on failure
+int check(int eq, const char *str);
+
+// Test count_bits and count_bits30 against getbit
+int test_count_bits();
+// Test the generated wheels against make_pwheel and is_prime_w with PWHEEL_30
+int test_wheels();
+// Test prime_sieve_bs against prime_sieve
+int test_sieve_bs();
+// Test prime_sieve_seg against trial division
+int test_sieve_seg();
+// Test prime_sieve_w30 and prime_sieve_w30_mt against trial division
+int test_sieve_w30();
+// Test w30_tuples and w30_gaps against scanning the bits one at a time
+int test_w30_patterns();
+// Test w30_aggregate on whole ranges against joining the reductions of pieces
+int test_prime_agg();
+// Test prime_count against sieving and known values
+int test_prime_count();
+// Test prime_iter_next and prime_iter_prev against sieving
+int test_prime_iter();
+// Test is_prime_mr, is_prime_mr64, and is_prime_mr_batch including moduli above 2^32
+int test_miller_rabin();
+// Test is_prime_bpsw against is_prime_mr64 and on pseudoprimes of each half of the test
+int test_bpsw();
+// Test factor_all and interleaved factor contexts against factorize_w
+int test_factor_ctx();
+// Test factorize_rho on small numbers and semiprimes with large factors
+int test_factorize_rho();
+// Test factorize_range against factorize_rho
+int test_factorize_range();
+// Test outbuf_u64 against printf
+int test_outbuf();
+// Test prime_reader on lists written with outbuf_varint and outbuf_u64le
+int test_prime_reader();
+// Test prime_sieve_w30_cache with empty, filled and damaged caches against prime_sieve_w30
+int test_sieve_cache();
+// Test inbuf_read on a mapped file, a pipe read in blocks and bad input
+int test_inbuf();
+
+
+
+// Binary run by test_sieve_cache to check that counting from the command line uses the cache
+#define PRIMES_BIN "./bin/primes"
+// Argument given to primes_test to only load the damaged cache in the directory after it
+#define DAMAGED_CACHE_ARG "--damaged-cache"
+// Sieve the range cached by test_sieve_cache in a fresh process where large blocks
+// come straight from mmap, so a damaged file unmapped twice unmaps malloc's buffer
+static int damaged_cache_child(const char *dir);
+
+int main(int argc, char *argv[]){
+	if(argc == 3 && strcmp(argv[1], DAMAGED_CACHE_ARG) == 0) return damaged_cache_child(argv[2]);
+	
+	int (*tests[])(void) = {
+		test_count_bits, test_wheels, test_sieve_bs, test_sieve_seg, test_sieve_w30, test_w30_patterns, test_prime_agg, test_prime_count, test_prime_iter, test_miller_rabin, test_bpsw, test_factor_ctx, test_factorize_rho, test_factorize_range, test_outbuf, test_prime_reader, test_sieve_cache, test_inbuf, NULL
+	};
+	
+	// Perform Tests
+	int fails = 0;
+	for(size_t i = 0; tests[i]; i++){
+		fails += tests[i]();
+		puts("+--------------------------+");
+	}
+	
+	printf("%i Failures\n", fails);
+	return fails;
+}
+
+
+
+int check(int eq, const char *str){
+	printf("%s: %s\n", str, eq ? "Success" : "FAILURE");
+	return !eq;
+}
+
+// Compare the sieve of [lower, upper] with trial division
+static int sieve_seg_matches(P_INT lower, P_INT upper){
+	bits_t bs = malloc(byte_size(upper - lower + 1));
+	P_INT count = prime_sieve_seg(bs, lower, upper), found = 0;
+	
+	int eq = 1;
+	for(P_INT x = lower; x <= upper; x++){
+		int pr = is_prime_w(x, PWHEEL_30);
+		found += pr;
+		if((int)getbit(bs, x - lower) != pr){
+			printf("Mismatch at %llu\n", x);
+			eq = 0;
+			break;
+		}
+	}
+	
+	free(bs);
+	return eq && count == found;
+}
+
+
+// Compare the wheel sieve of [lower, upper] with trial division
+static int sieve_w30_matches(P_INT lower, P_INT upper){
+	P_INT base = lower - lower % 30;
+	unsigned char *bs = malloc(w30_size(upper - base + 1));
+	P_INT count = prime_sieve_w30(bs, lower, upper), found = 0;
+	
+	int eq = 1;
+	for(P_INT x = base; x < base + 30 * w30_size(upper - base + 1); x++){
+		int pr = lower <= x && x <= upper && is_prime_w(x, PWHEEL_30);
+		found += pr;
+		if(x > 5 && getbit30(bs, x - base) != pr){
+			printf("Mismatch at %llu\n", x);
+			eq = 0;
+			break;
+		}
+	}
+	
+	free(bs);
+	return eq && count == found;
+}
+
+
+// Compare prime_sieve_w30_cache of [lower, upper] with prime_sieve_w30
+static int sieve_cache_matches(P_INT lower, P_INT upper, const char *dir){
+	size_t size = w30_size(upper - lower + lower % 30 + 1);
+	unsigned char *bs = malloc(size), *bs_cache = malloc(size);
+	P_INT count = prime_sieve_w30(bs, lower, upper);
+	int eq = prime_sieve_w30_cache(bs_cache, lower, upper, 1, dir) == count && memcmp(bs, bs_cache, size) == 0;
+	
+	free(bs_cache);
+	free(bs);
+	return eq;
+}
+
+
+// Check that primes and pows from a factorization multiply back to x
+static int factors_match(P_INT x, int len, P_INT *primes, int *pows){
+	P_INT prod = 1;
+	for(int i = 0; i < len; i++){
+		if(!is_prime_mr64(primes[i]) || (i > 0 && primes[i] <= primes[i - 1])) return 0;
+		for(int k = 0; k < pows[i]; k++) prod *= primes[i];
+	}
+	return x <= 1 ? len == 0 : prod == x;
+}
+
+
+// Compare each factorization given by factorize_range with factorize_rho
+static void range_matches(P_INT x, const P_INT *primes, const int *pows, int len, void *arg){
+	int *eq = arg;
+	P_INT rho_primes[RHO_MAX_FACTORS];
+	int rho_pows[RHO_MAX_FACTORS];
+	int rho_len = factorize_rho(x, rho_primes, rho_pows);
+	
+	if(len != rho_len) *eq = 0;
+	for(int i = 0; i < len && *eq; i++) *eq = primes[i] == rho_primes[i] && pows[i] == rho_pows[i];
+}
+
+
+
+int test_count_bits(){
+	int fails = 0;
+	
+	// Fill bit array with a fixed pseudorandom pattern
+	BIT_TYPE bs[32];
+	unsigned char *bytes = (unsigned char *)bs;
+	for(size_t i = 0; i < sizeof(bs); i++) bytes[i] = (unsigned char)(i * 167 + 13);
+	
+	// Try all ranges with ends near word boundaries
+	int eq = 1;
+	unsigned long long from, to, i, count;
+	for(from = 0; from < 8 * sizeof(bs) && eq; from += 7){
+		for(to = from; to <= 8 * sizeof(bs) && eq; to += 5){
+			for(count = 0, i = from; i < to; i++) count += getbit(bs, i);
+			eq = count == count_bits(bs, from, to);
+		}
+	}
+	fails += check(eq, "count_bits");
+	
+	for(count = 0, i = 0; i < 30 * 29; i++) count += getbit30(bytes, i);
+	fails += check(count == count_bits30(bytes, 29), "count_bits30");
+	
+	return fails;
+}
+
+int test_wheels(){
+	int fails = 0;
+	pwheel_t whls[] = {PWHEEL_210, PWHEEL_2310, PWHEEL_30030};
+	unsigned char maxes[] = {8, 12, 14};
+	const char *names[] = {"PWHEEL_210", "PWHEEL_2310", "PWHEEL_30030"};
+	
+	for(int w = 0; w < 3; w++){
+		// Same numbers must be generated as by the runtime wheel
+		pwheel_t made = make_pwheel(maxes[w]);
+		unsigned char *inc = NULL, *made_inc = NULL;
+		P_INT x, made_x;
+		int eq = lstprm_w(made) - fstprm_w(made) == lstprm_w(whls[w]) - fstprm_w(whls[w]);
+		for(int k = 0; k < 100000 && eq; k++){
+			nextnum_w(&inc, &x, whls[w]);
+			nextnum_w(&made_inc, &made_x, made);
+			eq = x == made_x;
+		}
+		free_pwheel(made);
+		
+		for(x = 0; x <= 100000 && eq; x++) eq = is_prime_w(x, whls[w]) == is_prime_w(x, PWHEEL_30);
+		fails += check(eq, names[w]);
+	}
+	
+	return fails;
+}
+
+int test_sieve_bs(){
+	int fails = 0;
+	
+	// Sizes below, at and beyond one period of the pattern
+	P_INT sizes[] = {1, 2, 3, 14, 64 * 30030, 64 * 30030 + 1, 5000000};
+	int eq = 1;
+	for(size_t k = 0; k < sizeof(sizes) / sizeof(P_INT) && eq; k++){
+		unsigned char *bytes = malloc(sizes[k]);
+		bits_t bs = malloc(byte_size(sizes[k]));
+		eq = prime_sieve(bytes, sizes[k]) == prime_sieve_bs(bs, sizes[k]);
+		for(P_INT x = 0; x < sizes[k] && eq; x++) eq = getbit(bs, x) == bytes[x];
+		free(bs);
+		free(bytes);
+	}
+	fails += check(eq, "prime_sieve_bs");
+	
+	return fails;
+}
+
+int test_sieve_seg(){
+	int fails = 0;
+	
+	fails += check(sieve_seg_matches(1, 1), "prime_sieve_seg [1, 1]");
+	fails += check(sieve_seg_matches(0, 1000), "prime_sieve_seg [0, 1000]");
+	fails += check(sieve_seg_matches(2, 3), "prime_sieve_seg [2, 3]");
+	fails += check(sieve_seg_matches(999000, 1600000), "prime_sieve_seg [999000, 1600000]");
+	fails += check(sieve_seg_matches(1000000000000ULL, 1000000100000ULL), "prime_sieve_seg [1e12, 1e12 + 1e5]");
+	
+	// Count of primes up to 10^7 is 664579
+	bits_t bs = malloc(byte_size(10000000));
+	fails += check(prime_sieve_seg(bs, 1, 10000000) == 664579, "prime_sieve_seg pi(1e7)");
+	free(bs);
+	
+	return fails;
+}
+
+
+int test_sieve_w30(){
+	int fails = 0;
+	
+	fails += check(sieve_w30_matches(1, 1), "prime_sieve_w30 [1, 1]");
+	fails += check(sieve_w30_matches(1, 1000), "prime_sieve_w30 [1, 1000]");
+	fails += check(sieve_w30_matches(3, 7), "prime_sieve_w30 [3, 7]");
+	fails += check(sieve_w30_matches(999001, 2600017), "prime_sieve_w30 [999001, 2600017]");
+	fails += check(sieve_w30_matches(1000000000007ULL, 1000000100000ULL), "prime_sieve_w30 [1e12 + 7, 1e12 + 1e5]");
+	
+	// Count of primes up to 10^8 is 5761455
+	unsigned char *bs = malloc(w30_size(100000001));
+	fails += check(prime_sieve_w30(bs, 1, 100000000) == 5761455, "prime_sieve_w30 pi(1e8)");
+	
+	// Threaded sieve must give the same bit array
+	unsigned char *bs_mt = malloc(w30_size(100000001));
+	P_INT count = prime_sieve_w30_mt(bs_mt, 1, 100000000, 4);
+	fails += check(count == 5761455 && memcmp(bs, bs_mt, w30_size(100000001)) == 0, "prime_sieve_w30_mt pi(1e8)");
+	free(bs_mt);
+	free(bs);
+	
+	// Range above the pattern's period which doesn't start at a multiple of it
+	P_INT lower = 10000000007ULL, upper = lower + 20000000;
+	bs = malloc(w30_size(upper - lower + lower % 30 + 1));
+	bits_t bs_seg = malloc(byte_size(upper - lower + 1));
+	fails += check(prime_sieve_w30(bs, lower, upper) == prime_sieve_seg(bs_seg, lower, upper), "prime_sieve_w30 [1e10 + 7, 1e10 + 2e7]");
+	free(bs_seg);
+	free(bs);
+	
+	// Large primes whose squares fall part way through the range wait in buckets
+	lower = 1000000000000ULL, upper = lower + 30000000;
+	bs = malloc(w30_size(upper - lower + lower % 30 + 1));
+	bs_seg = malloc(byte_size(upper - lower + 1));
+	fails += check(prime_sieve_w30(bs, lower, upper) == prime_sieve_seg(bs_seg, lower, upper), "prime_sieve_w30 [1e12, 1e12 + 3e7]");
+	free(bs_seg);
+	free(bs);
+	
+	return fails;
+}
+
+// Collect the first members of the matches found by w30_tuples
+struct tuples_found_s{
+	P_INT *ps;
+	P_INT len;
+};
+static void tuples_add(P_INT p, void *arg){
+	struct tuples_found_s *f = arg;
+	f->ps[f->len++] = p;
+}
+
+// Count the gaps given by w30_gaps keeping the first prime of the last one
+static void gaps_add(P_INT p, P_INT q, void *arg){
+	(void)q;
+	P_INT *recs = arg;
+	recs[0]++;
+	recs[1] = p;
+}
+
+// Compare the matches of each pattern and the record gaps in [from, to] of a sieve of [lower, upper] with a scan of every number
+static int w30_patterns_match(P_INT lower, P_INT upper, P_INT from, P_INT to){
+	static const P_INT pats[][4] = {{0, 2}, {0, 2, 6}, {0, 4, 6, 10}, {0, 6}, {0, 30}, {0, 210}};
+	static const size_t pat_lens[] = {2, 3, 4, 2, 2, 2};
+	P_INT base = lower - lower % 30, x, j, size = w30_size(upper - base + 1);
+	unsigned char *bs = malloc(size);
+	prime_sieve_w30(bs, lower, upper);
+	#define IS_PRIME(x) ((x) < 7 ? (x) == 2 || (x) == 3 || (x) == 5 : (x) <= upper && getbit30(bs, (x) - base))
+	
+	int eq = 1;
+	w30_tuple_t t;
+	P_INT *expect = malloc(sizeof(P_INT) * (to - from + 1));
+	struct tuples_found_s found = {malloc(sizeof(P_INT) * (to - from + 1)), 0};
+	for(size_t k = 0; k < sizeof(pat_lens) / sizeof(pat_lens[0]) && eq; k++){
+		w30_tuple_init(&t, pats[k], pat_lens[k]);
+		P_INT count = 0;
+		for(x = from; x <= to; x++){
+			for(j = 0; j < pat_lens[k] && pats[k][j] <= upper - x && IS_PRIME(x + pats[k][j]); j++);
+			if(j == pat_lens[k]) expect[count++] = x;
+			if(x == to) break;
+		}
+		
+		found.len = 0;
+		eq = w30_tuples(bs, base, upper, from, to, &t, tuples_add, &found) == count && found.len == count;
+		eq = eq && memcmp(found.ps, expect, count * sizeof(P_INT)) == 0;
+		eq = eq && w30_tuples(bs, base, upper, from, to, &t, NULL, NULL) == count;
+		if(!eq) printf("Mismatch for pattern %zu\n", k);
+	}
+	free(found.ps);
+	free(expect);
+	
+	// Record gaps from a plain walk of the primes
+	P_INT prev = 0, max = 0, first = 0, recs = 0, got[2] = {0, 0}, gap_first, gap_last;
+	for(x = from; x <= to; x++){
+		if(IS_PRIME(x)){
+			if(!first) first = x;
+			if(prev && x - prev > max) max = x - prev, recs++;
+			prev = x;
+		}
+		if(x == to) break;
+	}
+	eq = eq && w30_gaps(bs, base, from, to, 0, &gap_first, &gap_last, gaps_add, got) == max;
+	eq = eq && got[0] == recs && gap_first == first && gap_last == prev;
+	#undef IS_PRIME
+	
+	free(bs);
+	return eq;
+}
+
+int test_w30_patterns(){
+	int fails = 0;
+	
+	fails += check(w30_patterns_match(1, 1000, 1, 1000), "w30 patterns [1, 1000]");
+	fails += check(w30_patterns_match(1, 3000000, 1, 3000000), "w30 patterns [1, 3e6]");
+	fails += check(w30_patterns_match(3, 3000000, 1000003, 2000017), "w30 patterns [1e6 + 3, 2e6 + 17] of [3, 3e6]");
+	fails += check(w30_patterns_match(1000000000000ULL, 1000010000000ULL, 1000000000000ULL, 1000010000000ULL), "w30 patterns [1e12, 1e12 + 1e7]");
+	fails += check(w30_patterns_match(18446744073709551557ULL - 1000000, 18446744073709551615ULL, 18446744073709551557ULL - 1000000, 18446744073709551615ULL), "w30 patterns up to 2^64");
+	
+	// There are 440312 twin primes below 10^8 and the largest gap below 10^9 is 282 after 436273009
+	unsigned char *bs = malloc(w30_size(1000000001));
+	prime_sieve_w30(bs, 1, 1000000000);
+	w30_tuple_t t;
+	w30_tuple_init(&t, (P_INT[]){0, 2}, 2);
+	fails += check(w30_tuples(bs, 0, 1000000000, 1, 100000000, &t, NULL, NULL) == 440312, "w30_tuples twins below 1e8");
+	
+	P_INT recs[2] = {0, 0}, first, last;
+	fails += check(w30_gaps(bs, 0, 1, 1000000000, 0, &first, &last, gaps_add, recs) == 282 && recs[1] == 436273009, "w30_gaps below 1e9");
+	free(bs);
+	
+	return fails;
+}
+
+// Whether two reductions of primes are the same
+static int prime_agg_equal(const prime_agg_t *a, const prime_agg_t *b){
+	int eq = a->count == b->count && a->first == b->first && a->last == b->last && a->sum == b->sum;
+	eq = eq && a->sum_sq == b->sum_sq && a->hash == b->hash && a->hash_pow == b->hash_pow;
+	return eq && (!a->hist || memcmp(a->hist, b->hist, a->mod * sizeof(P_INT)) == 0);
+}
+
+// Compare the reductions of [lower, upper] with those of uneven pieces of it joined together
+static int prime_agg_pieces_match(P_INT lower, P_INT upper, P_INT mod){
+	P_INT base = lower - lower % 30, from, step = (upper - lower) / 7 + 1;
+	unsigned char *bs = malloc(w30_size(upper - base + 1));
+	prime_sieve_w30(bs, lower, upper);
+	
+	prime_agg_t whole, joined, piece;
+	prime_agg_init(&whole, mod);
+	prime_agg_init(&joined, mod);
+	prime_agg_init(&piece, mod);
+	w30_aggregate(bs, base, lower, upper, &whole);
+	for(from = lower; from <= upper; from += step){
+		P_INT to = upper - from < step ? upper : from + step - 1;
+		prime_agg_clear(&piece);
+		w30_aggregate(bs, base, from, to, &piece);
+		prime_agg_join(&joined, &piece);
+		if(to == upper) break;
+	}
+	
+	// Adding each prime on its own must also give the same
+	prime_agg_clear(&piece);
+	for(P_INT x = lower; x <= upper; x++){
+		if(x < 7 ? x == 2 || x == 3 || x == 5 : getbit30(bs, x - base)) prime_agg_add(&piece, x);
+		if(x == upper) break;
+	}
+	
+	int eq = prime_agg_equal(&whole, &joined) && prime_agg_equal(&whole, &piece);
+	prime_agg_free(&whole);
+	prime_agg_free(&joined);
+	prime_agg_free(&piece);
+	free(bs);
+	return eq;
+}
+
+int test_prime_agg(){
+	int fails = 0;
+	
+	fails += check(prime_agg_pieces_match(1, 2000000, 30), "w30_aggregate [1, 2e6] mod 30");
+	fails += check(prime_agg_pieces_match(999983, 3000017, 65536), "w30_aggregate [999983, 3000017] mod 65536");
+	fails += check(prime_agg_pieces_match(18446744073709551615ULL - 1000000, 18446744073709551615ULL, 1000000000000000009ULL), "w30_aggregate up to 2^64 mod 1e18 + 9");
+	
+	// The primes below 2 * 10^6 sum to 142913828922
+	unsigned char *bs = malloc(w30_size(2000000));
+	prime_sieve_w30(bs, 1, 1999999);
+	prime_agg_t agg;
+	prime_agg_init(&agg, 4);
+	w30_aggregate(bs, 0, 1, 1999999, &agg);
+	fails += check(agg.sum == 142913828922ULL && agg.count == 148933 && agg.hist[1] + agg.hist[3] + 1 == agg.count, "w30_aggregate sum below 2e6");
+	prime_agg_free(&agg);
+	free(bs);
+	
+	return fails;
+}
+
+int test_prime_count(){
+	int fails = 0;
+	
+	// Compare every count up to 10^4
+	int eq = 1;
+	P_INT x, count = 0;
+	for(x = 0; x <= 10000 && eq; x++){
+		count += is_prime_w(x, PWHEEL_30);
+		eq = prime_count(x) == count;
+	}
+	fails += check(eq, "prime_count x <= 1e4");
+	
+	fails += check(prime_count(100000000) == 5761455, "prime_count pi(1e8)");
+	fails += check(prime_count(1000000000000ULL) == 37607912018ULL, "prime_count pi(1e12)");
+	
+	return fails;
+}
+
+int test_prime_iter(){
+	int fails = 0;
+	
+	// Every prime up to 10^7 going forward then back again
+	P_INT x, p, n = 10000000;
+	unsigned char *bs = malloc(w30_size(n + 1));
+	prime_sieve_w30(bs, 1, n);
+	prime_iter_t it;
+	prime_iter_init(&it, 0);
+	int eq = 1;
+	for(x = 0; x <= n && eq; x++){
+		if(x < 7 ? x == 2 || x == 3 || x == 5 : getbit30(bs, x)) eq = prime_iter_next(&it) == x;
+	}
+	p = prime_iter_next(&it);
+	fails += check(eq && p == 10000019, "prime_iter_next x <= 1e7");
+	
+	eq = prime_iter_prev(&it) == p;
+	for(x = n + 1; x-- > 0 && eq;){
+		if(x < 7 ? x == 2 || x == 3 || x == 5 : getbit30(bs, x)) eq = prime_iter_prev(&it) == x;
+		if(x == 10000) p = prime_iter_next(&it), eq = eq && p == 10007 && prime_iter_prev(&it) == p;
+	}
+	fails += check(eq && prime_iter_prev(&it) == 0, "prime_iter_prev x <= 1e7");
+	prime_iter_free(&it);
+	free(bs);
+	
+	// Starting between primes and on a prime
+	prime_iter_init(&it, 100);
+	eq = prime_iter_prev(&it) == 97 && prime_iter_next(&it) == 97 && prime_iter_next(&it) == 101;
+	prime_iter_free(&it);
+	prime_iter_init(&it, 101);
+	eq = eq && prime_iter_next(&it) == 101;
+	prime_iter_free(&it);
+	fails += check(eq, "prime_iter_init");
+	
+	// Compare with sieve on a range high enough to need Miller-Rabin
+	P_INT lower = 1000000000000007ULL, upper = lower + 1000000, base = lower - lower % 30;
+	bs = malloc(w30_size(upper - base + 1));
+	prime_sieve_w30(bs, lower, upper);
+	prime_iter_init(&it, lower);
+	for(eq = 1, x = lower; x <= upper && eq; x++) if(getbit30(bs, x - base)) eq = prime_iter_next(&it) == x;
+	fails += check(eq, "prime_iter_next 1e15");
+	prime_iter_free(&it);
+	free(bs);
+	
+	// Stops after the largest 64-bit prime
+	prime_iter_init(&it, 18446744073709551000ULL);
+	for(p = 0, x = 0; (x = prime_iter_next(&it)); p = x);
+	eq = p == 18446744073709551557ULL && prime_iter_next(&it) == 0 && prime_iter_prev(&it) == p;
+	fails += check(eq, "prime_iter_next near 2^64");
+	prime_iter_free(&it);
+	
+	return fails;
+}
+
+int test_miller_rabin(){
+	int fails = 0;
+	
+	// Compare with sieve over small numbers
+	P_INT x, n = 1000000;
+	unsigned char *bs = malloc(w30_size(n + 1));
+	prime_sieve_w30(bs, 1, n);
+	int eq = 1;
+	for(x = 0; x <= n && eq; x++){
+		int pr = x < 7 ? x == 2 || x == 3 || x == 5 : getbit30(bs, x);
+		eq = is_prime_mr64(x) == pr;
+	}
+	fails += check(eq, "is_prime_mr64 x <= 1e6");
+	
+	// Compare with sieve on a range above 2^32
+	P_INT lower = 18446744073709000000ULL, upper = lower + 100000, base = lower - lower % 30;
+	bs = realloc(bs, w30_size(upper - base + 1));
+	prime_sieve_w30(bs, lower, upper);
+	for(eq = 1, x = lower; x <= upper && eq; x++) eq = is_prime_mr64(x) == getbit30(bs, x - base);
+	fails += check(eq, "is_prime_mr64 near 2^64");
+	free(bs);
+	
+	// Strong pseudoprimes to the first witnesses and the largest 64-bit prime
+	P_INT wits[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+	fails += check(is_prime_mr(3215031751ULL, 4, wits) == 1, "is_prime_mr 3215031751 bases 2-7");
+	fails += check(is_prime_mr64(3215031751ULL) == 0, "is_prime_mr64 3215031751");
+	fails += check(is_prime_mr64(3825123056546413051ULL) == 0, "is_prime_mr64 3825123056546413051");
+	fails += check(is_prime_mr(18446744073709551557ULL, 12, wits) == 1, "is_prime_mr 2^64 - 59");
+	fails += check(is_prime_mr64(18446744073709551557ULL) == 1, "is_prime_mr64 2^64 - 59");
+	
+	// Batch must agree with the single number test on small and large numbers
+	size_t i, len = 100000;
+	P_INT *xs = malloc(sizeof(P_INT) * len);
+	uint8_t *out = malloc(len);
+	for(i = 0; i < len; i++) xs[i] = i % 2 ? i : 18446744073709551557ULL - i;
+	is_prime_mr_batch(xs, len, out);
+	for(eq = 1, i = 0; i < len && eq; i++) eq = out[i] == is_prime_mr64(xs[i]);
+	fails += check(eq, "is_prime_mr_batch");
+	free(out);
+	free(xs);
+	
+	return fails;
+}
+
+int test_bpsw(){
+	int fails = 0;
+	
+	int eq = 1;
+	P_INT x;
+	for(x = 0; x <= 1000000 && eq; x++) eq = is_prime_bpsw(x) == is_prime_mr64(x);
+	fails += check(eq, "is_prime_bpsw x <= 1e6");
+	for(x = 18446744073709551615ULL - 100000; x != 0 && eq; x++) eq = is_prime_bpsw(x) == is_prime_mr64(x);
+	fails += check(eq, "is_prime_bpsw near 2^64");
+	
+	// Strong pseudoprimes to base 2, Lucas pseudoprimes and squares of primes
+	P_INT psps[] = {
+		2047, 3215031751ULL, 2152302898747ULL, 3825123056546413051ULL,
+		5459, 5777, 10877, 16109, 18971, 22499,
+		10403, 1000000007ULL * 1000000007ULL, 4294967291ULL * 4294967291ULL
+	};
+	for(size_t i = 0; i < sizeof(psps) / sizeof(P_INT) && eq; i++) eq = !is_prime_bpsw(psps[i]);
+	fails += check(eq, "is_prime_bpsw pseudoprimes");
+	fails += check(is_prime_bpsw(18446744073709551557ULL) == 1, "is_prime_bpsw 2^64 - 59");
+	
+	return fails;
+}
+
+int test_factor_ctx(){
+	int fails = 0;
+	P_INT primes[RHO_MAX_FACTORS];
+	int pows[RHO_MAX_FACTORS], len, pow;
+	
+	// Compare with the static state version
+	int eq = 1;
+	for(P_INT x = 0; x <= 100000 && eq; x++){
+		len = factor_all(x, PWHEEL_30, primes, pows);
+		eq = factors_match(x, len, primes, pows);
+		
+		if(x <= 1) continue;
+		int i = 0;
+		for(P_INT fac = factorize_w(x, PWHEEL_6, &pow); fac && eq; fac = factorize_w(0, NULL, &pow), i++)
+			eq = i < len && fac == primes[i] && pow == pows[i];
+		eq = eq && i == len;
+	}
+	fails += check(eq, "factor_all x <= 1e5");
+	
+	// Squares and products of primes on both sides of the default and of larger trial division table bounds
+	P_INT ps[] = {3, 30029, 30047, 60041, 1048573, 1051027, 1051051, 1299709, 4294967291ULL};
+	size_t n = sizeof(ps) / sizeof(P_INT);
+	for(size_t i = 0; i < n && eq; i++)
+		for(size_t j = i; j < n && eq; j++){
+			if(ps[i] > 100000000000000ULL / ps[j]) continue;
+			P_INT x = ps[i] * ps[j];
+			eq = !is_prime_w(x, PWHEEL_30) && is_prime_w(ps[j], PWHEEL_30);
+			len = factor_all(x, PWHEEL_30, primes, pows);
+			eq = eq && factors_match(x, len, primes, pows);
+			len = factor_all(x + 2, PWHEEL_30, primes, pows);
+			eq = eq && factors_match(x + 2, len, primes, pows) && is_prime_w(x + 2, PWHEEL_30) == is_prime_mr64(x + 2);
+		}
+	fails += check(eq, "factor_all around the table bound");
+	fails += check(is_prime_w(18446744073709551557ULL, PWHEEL_30030), "is_prime_w 2^64 - 59");
+	
+	// Trial division up to the root of a prime above (2^32 - 1)^2 must stop
+	len = factor_all(18446744073709551557ULL, PWHEEL_30030, primes, pows);
+	fails += check(len == 1 && primes[0] == 18446744073709551557ULL && pows[0] == 1, "factor_all 2^64 - 59");
+	
+	// Two contexts in use at once must not affect each other
+	factor_ctx_t a, b;
+	P_INT pa, pb;
+	int pow_b;
+	factor_init(&a, 540, PWHEEL_6);
+	factor_init(&b, 1000000007ULL * 999983ULL, PWHEEL_30);
+	pa = factor_next(&a, &pow);  pb = factor_next(&b, &pow_b);
+	eq = pa == 2 && pow == 2 && pb == 999983 && pow_b == 1;
+	pa = factor_next(&a, &pow);  pb = factor_next(&b, &pow_b);
+	eq = eq && pa == 3 && pow == 3 && pb == 1000000007ULL && pow_b == 1;
+	pa = factor_next(&a, &pow);  pb = factor_next(&b, &pow_b);
+	eq = eq && pa == 5 && pow == 1 && pb == 0;
+	eq = eq && factor_next(&a, &pow) == 0 && factor_next(&b, &pow_b) == 0;
+	fails += check(eq, "factor_next interleaved");
+	
+	return fails;
+}
+
+int test_factorize_rho(){
+	int fails = 0;
+	P_INT primes[RHO_MAX_FACTORS];
+	int pows[RHO_MAX_FACTORS], len;
+	
+	int eq = 1;
+	for(P_INT x = 0; x <= 100000 && eq; x++){
+		len = factorize_rho(x, primes, pows);
+		eq = factors_match(x, len, primes, pows);
+	}
+	fails += check(eq, "factorize_rho x <= 1e5");
+	
+	// Semiprimes and powers of primes near 2^32
+	P_INT xs[] = {
+		4294967291ULL * 4294967279ULL, 4294967291ULL * 4294967291ULL,
+		1000000007ULL * 998244353ULL, 2642243ULL * 2642243ULL * 2642243ULL,
+		18446744073709551557ULL, 614889782588491410ULL
+	};
+	for(size_t i = 0; i < sizeof(xs) / sizeof(P_INT) && eq; i++){
+		len = factorize_rho(xs[i], primes, pows);
+		eq = factors_match(xs[i], len, primes, pows);
+	}
+	fails += check(eq, "factorize_rho large");
+	
+	return fails;
+}
+
+int test_factorize_range(){
+	int fails = 0, eq;
+	
+	eq = 1;
+	factorize_range(0, 200000, range_matches, &eq);
+	fails += check(eq, "factorize_range [0, 2e5]");
+	
+	eq = 1;
+	factorize_range(1000000000000ULL, 1000000100000ULL, range_matches, &eq);
+	fails += check(eq, "factorize_range [1e12, 1e12 + 1e5]");
+	
+	return fails;
+}
+
+int test_outbuf(){
+	int fails = 0;
+	
+	// Numbers with every digit count including powers of ten and their neighbours
+	outbuf_t out;
+	outbuf_init(&out, -1, 1);
+	char expect[32 * 64 * 3], *e = expect;
+	P_INT x = 1;
+	for(int i = 0; i < 20; i++, x *= 10){
+		P_INT xs[] = {x - 1, x, x + 1};
+		for(int k = 0; k < 3; k++){
+			outbuf_u64(&out, xs[k]);
+			outbuf_put(&out, ",", 1);
+			e += sprintf(e, "%llu,", xs[k]);
+		}
+	}
+	outbuf_u64(&out, 18446744073709551615ULL);
+	e += sprintf(e, "%llu", 18446744073709551615ULL);
+	
+	fails += check(out.len == (size_t)(e - expect) && memcmp(out.buf, expect, out.len) == 0, "outbuf_u64");
+	outbuf_free(&out);
+	
+	// A failed flush is kept and later writes are dropped rather than attempted
+	int fd = open("/dev/full", O_WRONLY);
+	if(fd >= 0){
+		outbuf_init(&out, fd, 16);
+		for(int i = 0; i < 8; i++) outbuf_put(&out, "0123456789", 10);
+		fails += check(out.err == ENOSPC && out.written == 0, "outbuf_room failed flush");
+		fails += check(outbuf_flush(&out) == -1 && out.len == 0, "outbuf_flush after failure");
+		outbuf_free(&out);
+		close(fd);
+	}
+	
+	return fails;
+}
+
+int test_prime_reader(){
+	int fails = 0;
+	
+	// Primes near 2^64 have gaps needing more than one byte from 0
+	P_INT xs[] = {2, 3, 5, 7, 11, 1000003, 1000033, 4294967291ULL, 18446744073709551557ULL};
+	size_t i, len = sizeof(xs) / sizeof(P_INT);
+	outbuf_t var, le;
+	outbuf_init(&var, -1, 16);
+	outbuf_init(&le, -1, 16);
+	for(i = 0; i < len; i++){
+		outbuf_varint(&var, xs[i] - (i ? xs[i - 1] : 0));
+		outbuf_u64le(&le, xs[i]);
+	}
+	
+	prime_reader_t r;
+	P_INT p, got[16];
+	int eq = 1;
+	prime_reader_init(&r, var.buf, var.len, PRIME_FMT_DELTA_VARINT);
+	for(i = 0; i < len && eq; i++) eq = prime_reader_next(&r, &p) == 1 && p == xs[i];
+	fails += check(eq && prime_reader_next(&r, &p) == 0, "prime_reader_next delta-varint");
+	
+	prime_reader_init(&r, le.buf, le.len, PRIME_FMT_U64LE);
+	eq = prime_reader_read(&r, got, 16) == len;
+	for(i = 0; i < len && eq; i++) eq = got[i] == xs[i];
+	fails += check(eq, "prime_reader_read u64le");
+	
+	// Reading in pieces must continue from the last prime
+	prime_reader_init(&r, var.buf, var.len, PRIME_FMT_DELTA_VARINT);
+	eq = prime_reader_read(&r, got, 4) == 4 && prime_reader_read(&r, got + 4, 16) == len - 4;
+	for(i = 0; i < len && eq; i++) eq = got[i] == xs[i];
+	fails += check(eq, "prime_reader_read delta-varint");
+	
+	// A gap cut off in the middle is malformed
+	prime_reader_init(&r, var.buf, var.len - 1, PRIME_FMT_DELTA_VARINT);
+	for(i = 0; i < len - 1; i++) prime_reader_next(&r, &p);
+	fails += check(prime_reader_next(&r, &p) == -1, "prime_reader_next truncated");
+	
+	outbuf_free(&var);
+	outbuf_free(&le);
+	return fails;
+}
+
+static int damaged_cache_child(const char *dir){
+	mallopt(M_MMAP_THRESHOLD, 1 << 17);
+	return !sieve_cache_matches(1, 3 * SIEVE_CACHE_SEG_NUMS - 1, dir);
+}
+
+int test_sieve_cache(){
+	int fails = 0;
+	char dir[] = "/tmp/primes_test_XXXXXX";
+	if(!mkdtemp(dir)) return check(0, "prime_sieve_w30_cache mkdtemp");
+	
+	// Range crossing from segment 0 into segment 1
+	P_INT lower = SIEVE_CACHE_SEG_NUMS - 100003, upper = SIEVE_CACHE_SEG_NUMS + 200017;
+	fails += check(sieve_cache_matches(lower, upper, dir), "prime_sieve_w30_cache empty");
+	fails += check(sieve_cache_matches(lower, upper, dir), "prime_sieve_w30_cache filled");
+	fails += check(sieve_cache_matches(1, 1000, dir), "prime_sieve_w30_cache [1, 1000]");
+	
+	// Cache three whole segments then damage the headers of the first two
+	P_INT multi_upper = 3 * SIEVE_CACHE_SEG_NUMS - 1;
+	fails += check(sieve_cache_matches(1, multi_upper, dir), "prime_sieve_w30_cache three segments");
+	char path[4096];
+	for(P_INT seg = 0; seg < 2; seg++){
+		snprintf(path, sizeof(path), "%s/w30v%i-%016llx.seg", dir, SIEVE_CACHE_VERSION, seg);
+		FILE *f = fopen(path, "r+b");
+		if(f){
+			fputs("BAD", f);
+			fclose(f);
+		}
+	}
+	
+	// Load them in a new process so a crash doesn't stop the other tests
+	// Flush first so the child can't write out the results printed so far again
+	fflush(stdout);
+	fflush(stderr);
+	pid_t pid = fork();
+	if(pid == 0){
+		execl("/proc/self/exe", "primes_test", DAMAGED_CACHE_ARG, dir, (char *)NULL);
+		_exit(127);
+	}
+	int status = -1;
+	waitpid(pid, &status, 0);
+	fails += check(WIFEXITED(status) && WEXITSTATUS(status) == 0, "prime_sieve_w30_cache damaged");
+	fails += check(sieve_cache_matches(1, multi_upper, dir), "prime_sieve_w30_cache repaired");
+	
+	// Only counting a range large enough to be counted without sieving still fills the cache
+	snprintf(path, sizeof(path), "%s/w30v%i-%016llx.seg", dir, SIEVE_CACHE_VERSION, 3ULL);
+	unlink(path);
+	char upper_arg[32];
+	snprintf(upper_arg, sizeof(upper_arg), "1:%llu", 4 * SIEVE_CACHE_SEG_NUMS - 1);
+	fflush(stdout);
+	fflush(stderr);
+	pid = fork();
+	if(pid == 0){
+		if(!freopen("/dev/null", "w", stdout)) _exit(127);
+		execl(PRIMES_BIN, "primes", "-q", "-c", "-j", "1", "--cache", dir, "-n", upper_arg, (char *)NULL);
+		_exit(127);
+	}
+	waitpid(pid, &status, 0);
+	fails += check(WIFEXITED(status) && WEXITSTATUS(status) == 0 && access(path, F_OK) == 0, "primes -q -c --cache fills cache");
+	
+	// Remove cache
+	struct dirent *ent;
+	DIR *d = opendir(dir);
+	while((ent = readdir(d))){
+		if(ent->d_name[0] == '.') continue;
+		snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+		unlink(path);
+	}
+	closedir(d);
+	rmdir(dir);
+	
+	return fails;
+}
+
+
+// Read every number of path in small batches and check they count up from 0 to n - 1
+static int inbuf_counts_up(const char *path, P_INT n){
+	inbuf_t in;
+	if(inbuf_open(&in, path)) return 0;
+	
+	P_INT xs[1000], x = 0;
+	ptrdiff_t len, k;
+	int eq = 1;
+	while((len = inbuf_read(&in, xs, 1000)) > 0){
+		for(k = 0; k < len && eq; k++) eq = xs[k] == x++;
+	}
+	inbuf_close(&in);
+	return eq && len == 0 && x == n;
+}
+
+// Write s to a new temporary file whose name is left in path
+static void write_temp(char *path, const char *s){
+	int fd = mkstemp(path);
+	if(fd >= 0){
+		if(write(fd, s, strlen(s)) < 0) path[0] = '\0';
+		close(fd);
+	}
+}
+
+int test_inbuf(){
+	int fails = 0;
+	
+	// Numbers with every separator spread over several blocks
+	const char seps[] = " \n,\t\r\n  ";
+	P_INT x, n = 400000;
+	outbuf_t out;
+	outbuf_init(&out, -1, 1 << 22);
+	for(x = 0; x < n; x++){
+		outbuf_u64(&out, x);
+		outbuf_put(&out, seps + x % 6, 1 + x % 3);
+	}
+	outbuf_put(&out, "", 1);
+	
+	char path[] = "/tmp/primes_test_XXXXXX";
+	write_temp(path, out.buf);
+	fails += check(inbuf_counts_up(path, n), "inbuf_read mapped file");
+	unlink(path);
+	
+	// The same numbers through a pipe
+	int fds[2];
+	if(pipe(fds) == 0){
+		fflush(stdout);
+		fflush(stderr);
+		pid_t pid = fork();
+		if(pid == 0){
+			// Leave without flushing stdio so the results printed so far aren't written twice
+			close(fds[0]);
+			_exit(write(fds[1], out.buf, out.len - 1) != (ssize_t)out.len - 1);
+		}
+		close(fds[1]);
+		char fd_path[32];
+		sprintf(fd_path, "/dev/fd/%d", fds[0]);
+		fails += check(inbuf_counts_up(fd_path, n), "inbuf_read pipe");
+		close(fds[0]);
+		waitpid(pid, NULL, 0);
+	}
+	outbuf_free(&out);
+	
+	// Numbers before a bad character or one above 2^64 - 1 are still given
+	const char *bad[] = {"12 34x 5", "18446744073709551615 18446744073709551616"};
+	const size_t bad_at[] = {5, 21};
+	for(int k = 0; k < 2; k++){
+		char bad_path[] = "/tmp/primes_test_XXXXXX";
+		write_temp(bad_path, bad[k]);
+		inbuf_t in;
+		P_INT xs[4];
+		int eq = inbuf_open(&in, bad_path) == 0;
+		eq = eq && inbuf_read(&in, xs, 4) == 2 - k && inbuf_read(&in, xs, 4) == -1 && in.offset + in.pos == bad_at[k];
+		inbuf_close(&in);
+		unlink(bad_path);
+		fails += check(eq, k ? "inbuf_read above 2^64 - 1" : "inbuf_read bad character");
+	}
+	
+	return fails;
+}
@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "sieve_cache.h"
+
+// Header at the start of each cache file followed by the wheel bit array
+struct cache_hdr_s{
+	char magic[8];
+	uint32_t version;
+	uint32_t hdr_size;  // Offset of the bit array
+	uint64_t seg;  // Index of the segment
+	uint64_t bytes;  // Length of the bit array
+};
+
+static const char CACHE_MAGIC[8] = {'P', 'R', 'I', 'M', 'E', 'W', '3', '0'};
+
+// Path of the file for segment seg, with a temporary name if tmp is set
+static void cache_path(char *path, size_t len, const char *dir, P_INT seg, int tmp){
+	if(tmp) snprintf(path, len, "%s/.w30v%i-%016llx.%ld.tmp", dir, SIEVE_CACHE_VERSION, seg, (long)getpid());
+	else snprintf(path, len, "%s/w30v%i-%016llx.seg", dir, SIEVE_CACHE_VERSION, seg);
+}
+
+// Map the file of segment seg and check its header
+// Returns the bit array or NULL if it is missing or invalid, in which case *map is NULL
+static const unsigned char *cache_load(const char *dir, P_INT seg, size_t bytes, void **map, size_t *map_len){
+	*map = NULL;
+	*map_len = 0;
+	char path[4096];
+	cache_path(path, sizeof(path), dir, seg, 0);
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) return NULL;
+	
+	struct stat st;
+	size_t len = sizeof(struct cache_hdr_s) + bytes;
+	if(fstat(fd, &st) || (size_t)st.st_size != len){
+		close(fd);
+		return NULL;
+	}
+	
+	void *addr = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(addr == MAP_FAILED) return NULL;
+	
+	const struct cache_hdr_s *hdr = addr;
+	if(memcmp(hdr->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) || hdr->version != SIEVE_CACHE_VERSION
+		|| hdr->hdr_size != sizeof(struct cache_hdr_s) || hdr->seg != seg || hdr->bytes != bytes){
+		munmap(addr, len);
+		return NULL;
+	}
+	
+	// Only hand out the mapping once it is known to be valid
+	*map = addr;
+	*map_len = len;
+	return (const unsigned char *)addr + sizeof(struct cache_hdr_s);
+}
+
+// Write the bit array of segment seg to its file
+// Returns 0 on success
+static int cache_store(const char *dir, P_INT seg, const unsigned char *bs, size_t bytes){
+	char tmp[4096], path[4096];
+	cache_path(tmp, sizeof(tmp), dir, seg, 1);
+	cache_path(path, sizeof(path), dir, seg, 0);
+	
+	FILE *f = fopen(tmp, "wb");
+	if(!f) return -1;
+	struct cache_hdr_s hdr = {{0}, SIEVE_CACHE_VERSION, sizeof(struct cache_hdr_s), seg, bytes};
+	memcpy(hdr.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	
+	int err = fwrite(&hdr, sizeof(hdr), 1, f) != 1 || fwrite(bs, 1, bytes, f) != bytes;
+	err |= fclose(f) != 0;
+	// Rename only complete files so other readers never see part of one
+	if(err || rename(tmp, path)){
+		unlink(tmp);
+		return -1;
+	}
+	return 0;
+}
+
+P_INT prime_sieve_w30_cache(unsigned char *primality, P_INT lower, P_INT upper, unsigned int threads, const char *dir){
+	if(upper < lower) return 0;
+	P_INT base = lower - lower % 30, size = w30_size(upper - base + 1);
+	P_INT i, count = 0, seg;
+	unsigned char *buf = NULL;
+	
+	for(seg = lower / SIEVE_CACHE_SEG_NUMS; seg <= upper / SIEVE_CACHE_SEG_NUMS; seg++){
+		// The last segment stops at the largest 64-bit number
+		P_INT seg_lo = seg * SIEVE_CACHE_SEG_NUMS, seg_hi = seg_lo + (SIEVE_CACHE_SEG_NUMS - 1);
+		if(seg_hi < seg_lo) seg_hi = (P_INT)-1;
+		size_t bytes = w30_size(seg_hi - seg_lo + 1);
+		
+		void *map;
+		size_t map_len;
+		const unsigned char *data = cache_load(dir, seg, bytes, &map, &map_len);
+		if(!data){
+			if(!buf) buf = malloc(SIEVE_CACHE_SEG_BYTES);
+			prime_sieve_w30_mt(buf, seg_lo, seg_hi, threads);
+			cache_store(dir, seg, buf, bytes);
+			data = buf;
+		}
+		
+		// Copy the part of the segment overlapping [base, upper]
+		P_INT from = seg_lo > base ? (seg_lo - base) / 30 : 0, skip = seg_lo > base ? 0 : (base - seg_lo) / 30;
+		P_INT len = bytes - skip < size - from ? bytes - skip : size - from;
+		memcpy(primality + from, data + skip, len);
+		
+		if(map) munmap(map, map_len);
+	}
+	free(buf);
+	
+	// Count the wheel primes and remove everything outside of the range
+	unsigned char *wp;
+	for_primes_w(wp, PWHEEL_30) count += lower <= *wp && *wp <= upper;
+	for(i = base; i < lower; i++) if(W30_BIT[i % 30] < 8) clearbit30(primality, i - base);
+	for(i = upper - base + 1; i < 30 * size; i++) if(W30_BIT[i % 30] < 8) clearbit30(primality, i);
+	
+	return count + count_bits30(primality, size);
+}
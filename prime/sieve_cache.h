@@ -0,0 +1,38 @@
+#ifndef _SIEVE_CACHE_H
+#define _SIEVE_CACHE_H
+
+#include "primes.h"
+
+// Format version stored in every cache file, files of other versions are ignored
+#define SIEVE_CACHE_VERSION 1
+// Bytes of wheel bit array held by each cache file
+#define SIEVE_CACHE_SEG_BYTES (1 << 20)
+// Numbers covered by each cache file, starting from a multiple of this
+#define SIEVE_CACHE_SEG_NUMS (30ULL * SIEVE_CACHE_SEG_BYTES)
+
+/* Same as prime_sieve_w30_mt but keeps the wheel bit array of every
+ * segment it sieves in a file in dir. Later calls map the files of
+ * segments which are already present read-only instead of sieving
+ * them again. Files are written to a temporary name and then renamed
+ * so separate processes may share the same directory. If the cache
+ * can't be read or written the segment is sieved as usual.
+ * 
+ * Usage:
+ *   unsigned char *bs = malloc(w30_size(1000000 + 1));
+ *   prime_sieve_w30_cache(bs, 1, 1000000, 1, "/tmp/primes");  // Sieves and stores segment 0
+ *   prime_sieve_w30_cache(bs, 1, 1000000, 1, "/tmp/primes");  // Only reads segment 0
+ * 
+ * Arguments:
+ *   unsigned char *primality : location to store wheel bit array of at least
+ *     w30_size(upper - lower + lower % 30 + 1) bytes
+ *   P_INT lower : smallest number to include
+ *   P_INT upper : largest number to include
+ *   unsigned int threads : maximum number of threads used to sieve missing segments
+ *   const char *dir : existing directory holding the cache files
+ * 
+ * Returns:
+ *   P_INT : number of primes in [lower, upper]
+ */
+P_INT prime_sieve_w30_cache(unsigned char *primality, P_INT lower, P_INT upper, unsigned int threads, const char *dir);
+
+#endif
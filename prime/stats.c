@@ -0,0 +1,127 @@
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "stats.h"
+
+static const char *STATS_NAMES[STATS_PHASES] = {"wheel", "sieve", "count", "check", "output", "input"};
+
+static double clock_secs(clockid_t clk){
+	struct timespec ts;
+	clock_gettime(clk, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Open a hardware counter for this process and threads created after, -1 if not permitted
+static int perf_open(uint64_t config){
+#ifdef __linux__
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = config;
+	attr.inherit = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+	return -1;
+#endif
+}
+
+// Current value of a counter, the counts of joined threads are included
+static uint64_t perf_read(int fd){
+	uint64_t val = 0;
+	if(fd < 0 || read(fd, &val, sizeof(val)) != sizeof(val)) return 0;
+	return val;
+}
+
+void stats_init(stats_t *st, int enabled){
+	memset(st, 0, sizeof(*st));
+	st->enabled = enabled;
+	st->cur = -1;
+	st->perf_fd[0] = st->perf_fd[1] = -1;
+	if(!enabled) return;
+
+#ifdef __linux__
+	st->perf_fd[0] = perf_open(PERF_COUNT_HW_CPU_CYCLES);
+	st->perf_fd[1] = perf_open(PERF_COUNT_HW_CACHE_MISSES);
+#endif
+}
+
+void stats_begin(stats_t *st, int phase){
+	if(!st->enabled) return;
+	
+	st->cur = phase;
+	st->phase[phase].runs++;
+	for(int k = 0; k < 2; k++) st->perf0[k] = perf_read(st->perf_fd[k]);
+	st->cpu0 = clock_secs(CLOCK_PROCESS_CPUTIME_ID);
+	st->wall0 = clock_secs(CLOCK_MONOTONIC);
+}
+
+void stats_end(stats_t *st, uint64_t numbers){
+	if(!st->enabled || st->cur < 0) return;
+	stats_phase_t *p = st->phase + st->cur;
+	
+	p->wall += clock_secs(CLOCK_MONOTONIC) - st->wall0;
+	p->cpu += clock_secs(CLOCK_PROCESS_CPUTIME_ID) - st->cpu0;
+	p->cycles += perf_read(st->perf_fd[0]) - st->perf0[0];
+	p->cache_misses += perf_read(st->perf_fd[1]) - st->perf0[1];
+	p->numbers += numbers;
+	
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	p->peak_rss = usage.ru_maxrss;
+	st->cur = -1;
+}
+
+// Print the measurements of one phase after its name
+static void print_phase(const stats_t *st, const stats_phase_t *p, const char *name, FILE *f){
+	fprintf(f, "stats: %-6s wall=%.6fs cpu=%.6fs peak_rss=%ldKB", name, p->wall, p->cpu, p->peak_rss);
+	if(p->numbers){
+		fprintf(f, " numbers=%llu", (unsigned long long)p->numbers);
+		if(p->wall > 0) fprintf(f, " numbers_per_sec=%.0f", p->numbers / p->wall);
+	}
+	if(p->alloc) fprintf(f, " bitmap=%zuB", p->alloc);
+	if(p->written){
+		fprintf(f, " written=%zuB", p->written);
+		if(p->wall > 0) fprintf(f, " write_MBps=%.1f", p->written / p->wall / 1e6);
+	}
+	if(st->perf_fd[0] >= 0) fprintf(f, " cycles=%llu", (unsigned long long)p->cycles);
+	if(st->perf_fd[1] >= 0) fprintf(f, " cache_misses=%llu", (unsigned long long)p->cache_misses);
+	fputc('\n', f);
+}
+
+void stats_print(const stats_t *st, FILE *f){
+	if(!st->enabled) return;
+	
+	stats_phase_t total = {0};
+	for(int k = 0; k < STATS_PHASES; k++){
+		const stats_phase_t *p = st->phase + k;
+		if(!p->runs) continue;
+		print_phase(st, p, STATS_NAMES[k], f);
+		
+		total.wall += p->wall;
+		total.cpu += p->cpu;
+		total.cycles += p->cycles;
+		total.cache_misses += p->cache_misses;
+		total.alloc += p->alloc;
+		total.written += p->written;
+		if(p->peak_rss > total.peak_rss) total.peak_rss = p->peak_rss;
+	}
+	print_phase(st, &total, "total", f);
+	if(st->perf_fd[0] < 0) fprintf(f, "stats: hardware counters unavailable\n");
+}
+
+void stats_free(stats_t *st){
+	for(int k = 0; k < 2; k++){
+		if(st->perf_fd[k] >= 0) close(st->perf_fd[k]);
+		st->perf_fd[k] = -1;
+	}
+}
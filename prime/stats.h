@@ -0,0 +1,72 @@
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// Phases of a run which are measured separately
+#define STATS_WHEEL 0  // Building the wheel
+#define STATS_SIEVE 1  // Sieving the whole range up front
+#define STATS_COUNT 2  // Counting the primes of the range with prime_count
+#define STATS_CHECK 3  // Checking or factorizing the numbers of the range
+#define STATS_OUTPUT 4  // Joining and writing out the results
+#define STATS_INPUT 5  // Reading and parsing numbers from the input
+#define STATS_PHASES 6
+
+// Totals for one phase over every time it ran
+typedef struct stats_phase_s{
+	double wall, cpu;  // Seconds of monotonic and process CPU time
+	uint64_t cycles, cache_misses;  // Hardware counters, only set if they could be opened
+	long peak_rss;  // Peak resident set size in KB when the phase last ended
+	uint64_t numbers;  // Numbers sieved, checked or factorized
+	size_t alloc;  // Bytes allocated for the bit array
+	size_t written;  // Bytes written out
+	unsigned int runs;  // Times the phase was started
+} stats_phase_t;
+
+typedef struct stats_s{
+	int enabled;
+	int perf_fd[2];  // Cycle and cache miss counters or -1 if unavailable
+	stats_phase_t phase[STATS_PHASES];
+	
+	// Readings taken when the current phase began
+	int cur;
+	double wall0, cpu0;
+	uint64_t perf0[2];
+} stats_t;
+
+/* Setup statistics collection
+ * When enabled the cycle and cache miss counters of perf_event_open are
+ * opened for this process and the threads it creates afterwards,
+ * without them only times and memory are reported
+ * 
+ * Usage:
+ *   stats_t st;
+ *   stats_init(&st, 1);
+ *   stats_begin(&st, STATS_CHECK);
+ *   ...  // Check 1000 numbers
+ *   stats_end(&st, 1000);
+ *   stats_print(&st, stderr);
+ *   stats_free(&st);
+ * 
+ * Arguments:
+ *   stats_t *st : statistics to setup
+ *   int enabled : whether to collect anything, otherwise every call does nothing
+ */
+void stats_init(stats_t *st, int enabled);
+
+// Start measuring a phase, STATS_WHEEL to STATS_INPUT
+void stats_begin(stats_t *st, int phase);
+
+// Stop measuring the current phase and add the given numbers handled to it
+// Phases which don't visit each number, such as STATS_COUNT, should give 0
+void stats_end(stats_t *st, uint64_t numbers);
+
+// Print a line for every phase that ran followed by the totals
+void stats_print(const stats_t *st, FILE *f);
+
+// Close the hardware counters
+void stats_free(stats_t *st);
+
+#endif